@@ -0,0 +1,119 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "xfconf-batch.h"
+#include "sound-player.h"
+#include "notification.h"
+#include "alert-executor.h"
+#include "alert-coalescer.h"
+#include "journal.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+
+// Total size of sound files kept uploaded to sound server
+#define SOUND_CACHE_BUDGET (8 * 1024 * 1024)
+// Alert programs running at once, others wait for their turn
+#define ALERT_MAX_CHILDREN 8
+
+
+// Callbacks
+static void
+alert_dismissed(gpointer key, AlarmContext *context)
+{
+  acknowledge_alarm(context, ALARM_PLUGIN_ALARM(key));
+}
+
+
+// External interface
+/* Takes ownership of clock. Settings are persisted in xfconf channel_name
+ * under property_base, which requires xfconf to be initialized by caller.
+ * With NULL channel_name alarms live in memory only. */
+AlarmContext*
+alarm_context_new(Clock *clock, const gchar *channel_name, const gchar *property_base)
+{
+  AlarmContext *context;
+
+  g_return_val_if_fail(clock != NULL, NULL);
+  g_return_val_if_fail(channel_name == NULL || property_base != NULL, NULL);
+
+  context = g_slice_new0(AlarmContext);
+  context->alarms = g_ptr_array_new_with_free_func(g_object_unref);
+  context->alarm_ids = g_hash_table_new(NULL, NULL);
+  context->next_id = ALARM_ID_UNASSIGNED + 1;
+  context->alert = alert_new();
+  context->dirty_alarms = g_hash_table_new_full(NULL, NULL, g_object_unref, NULL);
+  context->save_id = 0;
+  context->lazy_binding = FALSE;
+
+  context->channel_name = g_strdup(channel_name);
+  context->property_base = g_strdup(property_base);
+  context->profiler = profiler_new();
+  if (channel_name)
+    context->settings = xfconf_batch_new(channel_name, context->profiler);
+  context->clock = clock;
+  context->scheduler = scheduler_new(clock);
+  context->sounds = sound_player_new(SOUND_CACHE_BUDGET);
+  context->notifier = notifier_new(context->scheduler);
+  context->executor = alert_executor_new(context->scheduler, context->sounds,
+                                         context->notifier, ALERT_MAX_CHILDREN,
+                                         (AlertExecutorFunc) alert_dismissed, context);
+  context->coalescer = alert_coalescer_new(context->scheduler, context->executor,
+                                           ALERT_COALESCER_DEFAULT_WINDOW);
+  context->journal = NULL;
+
+  return context;
+}
+
+void
+alarm_context_free(AlarmContext *context)
+{
+  if (context == NULL)
+    return;
+
+  // Settings changed in current main loop iteration are written out first
+  save_dirty_alarms(context);
+
+  g_clear_pointer(&context->journal, journal_close);
+  g_clear_pointer(&context->coalescer, alert_coalescer_free);
+  g_clear_pointer(&context->executor, alert_executor_free);
+  g_clear_pointer(&context->notifier, notifier_free);
+  g_clear_pointer(&context->scheduler, scheduler_free);
+  g_clear_pointer(&context->clock, clock_free);
+  g_clear_pointer(&context->dirty_alarms, g_hash_table_destroy);
+  g_clear_pointer(&context->settings, xfconf_batch_free);
+  g_clear_pointer(&context->profiler, profiler_free);
+  g_clear_pointer(&context->sounds, sound_player_free);
+  g_clear_pointer(&context->alarm_ids, g_hash_table_destroy);
+  g_clear_pointer(&context->alarms, g_ptr_array_unref);
+  g_clear_object(&context->alert);
+  g_free(context->channel_name);
+  g_free(context->property_base);
+
+  g_slice_free(AlarmContext, context);
+}
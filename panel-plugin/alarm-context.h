@@ -0,0 +1,56 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_ALARM_CONTEXT_H__
+#define __ALARM_PLUGIN_ALARM_CONTEXT_H__
+
+G_BEGIN_DECLS
+
+/* Alarms together with services running them, independent of the panel.
+ * Plugin owns one, tests and benchmarks create their own. Services are only
+ * declared here, so users include headers of services they actually call. */
+typedef struct _AlarmContext
+{
+  GPtrArray *alarms;
+  GHashTable *alarm_ids; // alarm->id => Alarm*
+  guint next_id;
+  struct _Alert *alert; // Default alert
+  GHashTable *dirty_alarms; // Alarm* with settings changed since last save
+  guint save_id; // Idle source saving dirty alarms
+  gboolean lazy_binding;
+
+  gchar *channel_name; // NULL if settings are not persisted
+  gchar *property_base;
+  struct _XfconfBatch *settings; // NULL if settings are not persisted
+  struct _Profiler *profiler;
+  struct _Clock *clock;
+  struct _Scheduler *scheduler;
+  struct _SoundPlayer *sounds; // NULL if sound server is unavailable
+  struct _Notifier *notifier;
+  struct _AlertExecutor *executor;
+  struct _AlertCoalescer *coalescer;
+  struct _Journal *journal; // NULL until opened by owner
+} AlarmContext;
+
+AlarmContext* alarm_context_new(struct _Clock *clock, const gchar *channel_name,
+                                const gchar *property_base);
+void alarm_context_free(AlarmContext *context);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_ALARM_CONTEXT_H__ */
@@ -27,12 +27,16 @@
 #include <xfconf/xfconf.h>
 
 #include "common.h"
+#include "common-ui.h"
 #include "alert.h"
+#include "rerun.h"
+#include "alarm-context.h"
 #include "alarm-plugin.h"
 #include "alarm.h"
 #include "alarm-dialog.h"
 #include "alarm-dialog_ui.h"
 #include "alert-box.h"
+#include "tracing.h"
 
 enum DoWColumns
 {
@@ -331,14 +335,17 @@ show_alarm_dialog(GtkWidget *parent, XfcePanelPlugin *panel_plugin, Alarm **alar
   AlarmPlugin *plugin = XFCE_ALARM_PLUGIN(panel_plugin);
   GtkBuilder *builder;
   GObject *dialog, *object, *store;
-  GList *alarm_iter;
+  guint i;
   Alarm *triggered_timer, *shown_alarm = NULL;
   gchar *alarm_strid = NULL;
+  gint64 trace_start;
 
   g_return_if_fail(GTK_IS_WINDOW(parent));
   g_return_if_fail(XFCE_IS_PANEL_PLUGIN(panel_plugin));
   g_return_if_fail(alarm != NULL);
 
+  TRACE_BEGIN(trace_start);
+
   builder = alarm_builder_new(panel_plugin, "alarm-dialog", &dialog,
                               alarm_dialog_ui, alarm_dialog_ui_length,
                               NULL);
@@ -371,10 +378,9 @@ show_alarm_dialog(GtkWidget *parent, XfcePanelPlugin *panel_plugin, Alarm **alar
                                     TT_COL_ID, alarm_strid, -1);
   g_free(alarm_strid);
 
-  alarm_iter = plugin->alarms;
-  while (alarm_iter)
+  for (i = 0; i < plugin->context->alarms->len; i++)
   {
-    triggered_timer = alarm_iter->data;
+    triggered_timer = g_ptr_array_index(plugin->context->alarms, i);
     if (triggered_timer->type == ALARM_TYPE_TIMER && triggered_timer != *alarm)
     {
       alarm_strid = g_strdup_printf("alarm-%u", triggered_timer->id);
@@ -384,13 +390,12 @@ show_alarm_dialog(GtkWidget *parent, XfcePanelPlugin *panel_plugin, Alarm **alar
                                         TT_COL_ID, alarm_strid, -1);
       g_free(alarm_strid);
     }
-    alarm_iter = alarm_iter->next;
   }
   gtk_combo_box_set_active(GTK_COMBO_BOX(object), 0);
 
-  shown_alarm = alarm_new(NULL);
+  shown_alarm = alarm_new();
   g_object_copy(G_OBJECT(*alarm), G_OBJECT(shown_alarm));
-  shown_alarm->alert = alert_new(NULL);
+  shown_alarm->alert = alert_new();
   if (*alarm)
     g_object_copy(G_OBJECT((*alarm)->alert), G_OBJECT(shown_alarm->alert));
 
@@ -401,6 +406,8 @@ show_alarm_dialog(GtkWidget *parent, XfcePanelPlugin *panel_plugin, Alarm **alar
   object = gtk_builder_get_object(builder, "alert-alignment");
   g_return_if_fail(GTK_IS_CONTAINER(object));
   g_return_if_fail(show_alert_box(shown_alarm->alert, panel_plugin, GTK_CONTAINER(object)));
+  // Only building dialog is traced, not the time it is shown
+  TRACE_END(trace_start, "show alarm dialog", "%u alarms", plugin->context->alarms->len);
 
   if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_APPLY)
   {
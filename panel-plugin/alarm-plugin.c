@@ -25,11 +25,51 @@
 #include <xfconf/xfconf.h>
 
 #include "alert.h"
+#include "clock.h"
+#include "app-cache.h"
+#include "sound-player.h"
+#include "power-monitor.h"
+#include "journal.h"
+#include "statistics.h"
+#include "rerun.h"
+#include "alarm-context.h"
 #include "alarm-plugin.h"
 #include "alarm.h"
+#include "alarm-store.h"
 #include "properties-dialog.h"
+#include "progress-view.h"
+
+// Utilities
+// Journal lives in $XDG_STATE_HOME, as it is neither configuration nor cache
+static gchar*
+journal_filename(AlarmPlugin *plugin)
+{
+  const gchar *state_dir;
+  gchar *basename, *filename;
+
+  state_dir = g_getenv("XDG_STATE_HOME");
+  basename = g_strdup_printf("alarm-%d.journal",
+                             xfce_panel_plugin_get_unique_id(XFCE_PANEL_PLUGIN(plugin)));
+  if (state_dir && g_path_is_absolute(state_dir))
+    filename = g_build_filename(state_dir, "xfce4", "xfce4-alarm-plugin", basename, NULL);
+  else
+    filename = g_build_filename(g_get_home_dir(), ".local", "state", "xfce4",
+                                "xfce4-alarm-plugin", basename, NULL);
+  g_free(basename);
+
+  return filename;
+}
+
 
 // Callbacks
+static void
+power_changed(gboolean suspending, AlarmPlugin *plugin)
+{
+  alarm_context_power_changed(suspending, plugin->context);
+  if (!suspending && plugin->progress_view)
+    progress_view_refresh(ALARM_PLUGIN_PROGRESS_VIEW(plugin->progress_view));
+}
+
 static gboolean
 panel_size_changed(XfcePanelPlugin *panel_plugin, gint size)
 {
@@ -48,26 +88,9 @@ static void
 panel_orientation_changed(XfcePanelPlugin *panel_plugin, GtkOrientation orientation)
 {
   AlarmPlugin *plugin = XFCE_ALARM_PLUGIN(panel_plugin);
-  GList *progress_bar_iter;
-  GtkWidget *progress_bar, *box = gtk_bin_get_child(GTK_BIN(plugin->panel_button));
 
-  gtk_orientable_set_orientation(GTK_ORIENTABLE(box), orientation);
-
-  progress_bar_iter = gtk_container_get_children(GTK_CONTAINER(box));
-  while (progress_bar_iter)
-  {
-    progress_bar = GTK_WIDGET(progress_bar_iter->data);
-    if (orientation == GTK_ORIENTATION_HORIZONTAL)
-    {
-      gtk_orientable_set_orientation(GTK_ORIENTABLE(progress_bar), GTK_ORIENTATION_VERTICAL);
-      gtk_progress_bar_set_inverted(GTK_PROGRESS_BAR(progress_bar), TRUE);
-    } else {
-      gtk_orientable_set_orientation(GTK_ORIENTABLE(progress_bar), GTK_ORIENTATION_HORIZONTAL);
-      gtk_progress_bar_set_inverted(GTK_PROGRESS_BAR(progress_bar), FALSE);
-    }
-    progress_bar_iter = progress_bar_iter->next;
-  }
-  g_list_free(g_steal_pointer(&progress_bar_iter));
+  progress_view_set_orientation(ALARM_PLUGIN_PROGRESS_VIEW(plugin->progress_view),
+                                orientation);
 
   panel_size_changed(panel_plugin, xfce_panel_plugin_get_size(panel_plugin));
 }
@@ -81,6 +104,13 @@ panel_button_toggled(GtkWidget *panel_button, AlarmPlugin *plugin)
   if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(panel_button)))
     return;
 
+  // Click during alert acknowledges it (stops sound loops and repeats)
+  if (acknowledge_all_alarms(plugin->context))
+  {
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(panel_button), FALSE);
+    return;
+  }
+
   //xfce_panel_plugin_block_autohide(XFCE_PANEL_PLUGIN(plugin), TRUE);
 }
 
@@ -92,25 +122,54 @@ static void
 plugin_construct(XfcePanelPlugin *panel_plugin)
 {
   AlarmPlugin *plugin = XFCE_ALARM_PLUGIN(panel_plugin);
-  gchar *property_base;
-  XfconfChannel *channel;
-  GtkWidget *box;
+  AlarmContext *context;
+  Alarm *alarm;
+  gchar *filename;
+  guint i;
 
   xfce_textdomain(GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR, "UTF-8");
   xfce_panel_plugin_menu_show_configure(panel_plugin);
   xfce_panel_plugin_set_small(panel_plugin, TRUE);
 
-  plugin->alarms = load_alarm_settings(plugin);
+  // Property base is known only once plugin is constructed
+  context = alarm_context_new(clock_new(), xfce_panel_get_channel_name(),
+                              xfce_panel_plugin_get_property_base(panel_plugin));
+  plugin->context = context;
+  g_ptr_array_unref(context->alarms);
+  context->alarms = load_alarm_settings(context);
+
+  filename = journal_filename(plugin);
+  context->journal = journal_open(filename);
+  g_free(filename);
+  replay_alarm_journal(context);
+
+  // In lazy binding mode alarms are bound only once edited or started
+  if (!context->lazy_binding)
+  {
+    bind_alert_settings(context);
+    for (i = 0; i < context->alarms->len; i++)
+      bind_alarm_settings(context, g_ptr_array_index(context->alarms, i));
+  }
+
+  // Resume alarms running before panel restart
+  for (i = 0; i < context->alarms->len; i++)
+    schedule_alarm(context, g_ptr_array_index(context->alarms, i));
 
-  // Bind default alert properties to xfconf properties
-  property_base = g_strconcat(xfce_panel_plugin_get_property_base(panel_plugin),
-                              "/default-alert", NULL);
-  channel = xfconf_channel_new_with_property_base(xfce_panel_get_channel_name(),
-                                                  property_base);
-  g_free(property_base);
-  plugin->alert = alert_new(channel);
-  g_object_weak_ref(G_OBJECT(plugin->alert), (GWeakNotify) G_CALLBACK(g_object_unref),
-                    channel);
+  plugin->power = power_monitor_new((PowerMonitorFunc) power_changed, plugin);
+  plugin->statistics = statistics_new(context,
+                                      xfce_panel_plugin_get_unique_id(panel_plugin));
+
+  // Upload configured alert sounds ahead of first playback
+  if (context->sounds)
+  {
+    sound_player_cache(context->sounds, context->alert->sound);
+    for (i = 0; i < context->alarms->len; i++)
+    {
+      alarm = g_ptr_array_index(context->alarms, i);
+      if (alarm->alert)
+        sound_player_cache(context->sounds, alarm->alert->sound);
+    }
+  }
 
   // Panel toggle button
   plugin->panel_button = xfce_panel_create_toggle_button();
@@ -120,13 +179,11 @@ plugin_construct(XfcePanelPlugin *panel_plugin)
   g_signal_connect(G_OBJECT(plugin->panel_button), "toggled",
                    G_CALLBACK(panel_button_toggled), plugin);
 
-  // Container for progress bars
-  box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-  gtk_container_add(GTK_CONTAINER(plugin->panel_button), box);
-
-  // Blank progress bar insted of icon
-  // TODO: change to insert icon when no active progress bars
-  gtk_box_pack_start(GTK_BOX(box), gtk_progress_bar_new(), TRUE, FALSE, 0);
+  // Progress of all running alarms is drawn by single widget
+  // TODO: show icon when no alarms are running
+  plugin->store = alarm_store_new(context);
+  plugin->progress_view = progress_view_new(context, plugin->store);
+  gtk_container_add(GTK_CONTAINER(plugin->panel_button), plugin->progress_view);
   panel_orientation_changed(panel_plugin,
                             xfce_panel_plugin_get_orientation(panel_plugin));
 
@@ -138,8 +195,17 @@ plugin_free_data(XfcePanelPlugin *panel_plugin)
 {
   AlarmPlugin *plugin = XFCE_ALARM_PLUGIN(panel_plugin);
 
-  g_list_free_full(g_steal_pointer(&plugin->alarms), (GDestroyNotify) g_object_unref);
-  g_clear_object(&plugin->alert);
+  // Progress view watches alarms, so it goes before them
+  if (plugin->panel_button)
+    gtk_widget_destroy(plugin->panel_button);
+  plugin->panel_button = NULL;
+  plugin->progress_view = NULL;
+  g_clear_object(&plugin->store);
+
+  g_clear_pointer(&plugin->statistics, statistics_free);
+  g_clear_pointer(&plugin->power, power_monitor_free);
+  g_clear_pointer(&plugin->context, alarm_context_free);
+  g_clear_pointer(&plugin->apps, app_cache_free);
 }
 
 
@@ -174,7 +240,11 @@ alarm_plugin_init(AlarmPlugin *plugin)
   }
   g_object_weak_ref(G_OBJECT(plugin), (GWeakNotify) xfconf_shutdown, NULL);
 
-  plugin->alarms = NULL;
-  plugin->alert = NULL;
+  plugin->context = NULL;
+  plugin->apps = app_cache_new();
+  plugin->power = NULL;
+  plugin->statistics = NULL;
+  plugin->store = NULL;
   plugin->panel_button = NULL;
+  plugin->progress_view = NULL;
 }
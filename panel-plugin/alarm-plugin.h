@@ -31,10 +31,13 @@ typedef struct _AlarmPlugin
 {
   XfcePanelPlugin parent;
 
-  GList *alarms;
-  Alert *alert;
-  GTimer *timer;
+  struct _AlarmContext *context; // NULL until constructed
+  struct _AppCache *apps;
+  struct _PowerMonitor *power;
+  struct _Statistics *statistics;
+  struct _AlarmStore *store; // Shared by properties dialog and progress view
   GtkWidget *panel_button;
+  GtkWidget *progress_view;
 } AlarmPlugin;
 
 #define XFCE_TYPE_ALARM_PLUGIN (alarm_plugin_get_type ())
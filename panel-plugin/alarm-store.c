@@ -0,0 +1,568 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "alert.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+#include "alarm-store.h"
+
+#define UNICODE_BLOCK "\xe2\x96\x8a"
+
+/* Tree model backed directly by AlarmContext.alarms. Iterator holds Alarm*
+ * and row number is Alarm.position, so no per-row data is copied. Markup is
+ * formatted only for rows requested by view and cached until alarm changes.
+ * Only rows that have been displayed are tracked for changes; changes are
+ * collected and announced with one row-changed per row from idle. */
+struct _AlarmStore
+{
+  GObject parent;
+
+  AlarmContext *context;
+  gint stamp;
+  GHashTable *rows; // Alarm* => AlarmRow*
+  GHashTable *changed_rows; // Alarm* set
+  guint changed_source_id;
+};
+
+typedef struct
+{
+  AlarmStore *store;
+  Alarm *alarm;
+  gulong notify_id;
+  gchar *time;
+  gchar *color;
+  gboolean color_cached; // Color markup is NULL for alarm without color
+} AlarmRow;
+
+static void alarm_store_tree_model_init(GtkTreeModelIface *iface);
+static void alarm_store_drag_source_init(GtkTreeDragSourceIface *iface);
+static void alarm_store_drag_dest_init(GtkTreeDragDestIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(AlarmStore, alarm_store, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, alarm_store_tree_model_init)
+    G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_DRAG_SOURCE, alarm_store_drag_source_init)
+    G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_DRAG_DEST, alarm_store_drag_dest_init))
+
+
+// Utilities
+#define VALID_ITER(store, iter) ((iter) != NULL && (iter)->stamp == (store)->stamp && \
+                                 (iter)->user_data != NULL)
+
+static void
+alarm_store_set_iter(AlarmStore *store, GtkTreeIter *iter, Alarm *alarm)
+{
+  iter->stamp = store->stamp;
+  iter->user_data = alarm;
+  iter->user_data2 = NULL;
+  iter->user_data3 = NULL;
+}
+
+static GtkTreePath*
+alarm_store_path_for_alarm(Alarm *alarm)
+{
+  return gtk_tree_path_new_from_indices(alarm->position, -1);
+}
+
+static void
+alarm_row_free(AlarmRow *row)
+{
+  g_signal_handler_disconnect(row->alarm, row->notify_id);
+  g_free(row->time);
+  g_free(row->color);
+  g_slice_free(AlarmRow, row);
+}
+
+static gboolean
+alarm_store_emit_changed(gpointer data)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(data);
+  GHashTable *changed_rows;
+  GHashTableIter ht_iter;
+  Alarm *alarm;
+  GtkTreeIter iter;
+  GtkTreePath *path;
+
+  // Changes made by row-changed handlers are collected for the next batch
+  store->changed_source_id = 0;
+  changed_rows = g_steal_pointer(&store->changed_rows);
+  store->changed_rows = g_hash_table_new(NULL, NULL);
+
+  g_hash_table_iter_init(&ht_iter, changed_rows);
+  while (g_hash_table_iter_next(&ht_iter, (gpointer) &alarm, NULL))
+  {
+    alarm_store_set_iter(store, &iter, alarm);
+    path = alarm_store_path_for_alarm(alarm);
+    gtk_tree_model_row_changed(GTK_TREE_MODEL(store), path, &iter);
+    gtk_tree_path_free(path);
+  }
+  g_hash_table_destroy(changed_rows);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Drops cached markup of changed column only
+static void
+alarm_notify(Alarm *alarm, GParamSpec *pspec, AlarmRow *row)
+{
+  AlarmStore *store = row->store;
+
+  if (pspec->name == g_intern_static_string("time"))
+    g_clear_pointer(&row->time, g_free);
+  else if (pspec->name == g_intern_static_string("color"))
+  {
+    g_clear_pointer(&row->color, g_free);
+    row->color_cached = FALSE;
+  }
+  else if (pspec->name != g_intern_static_string("name") &&
+           pspec->name != g_intern_static_string("type"))
+    return;
+
+  g_hash_table_add(store->changed_rows, alarm);
+  if (store->changed_source_id == 0)
+    store->changed_source_id = g_idle_add(alarm_store_emit_changed, store);
+}
+
+static AlarmRow*
+alarm_store_get_row(AlarmStore *store, Alarm *alarm)
+{
+  AlarmRow *row;
+
+  row = g_hash_table_lookup(store->rows, alarm);
+  if (row == NULL)
+  {
+    row = g_slice_new0(AlarmRow);
+    row->store = store;
+    row->alarm = alarm;
+    row->notify_id = g_signal_connect(alarm, "notify", G_CALLBACK(alarm_notify), row);
+    g_hash_table_insert(store->rows, alarm, row);
+  }
+
+  return row;
+}
+
+static const gchar*
+alarm_store_get_time_markup(AlarmStore *store, Alarm *alarm)
+{
+  AlarmRow *row = alarm_store_get_row(store, alarm);
+
+  if (row->time == NULL)
+    row->time = g_strdup_printf("<span size=\"large\" weight=\"normal\">%02u:%02u</span>" \
+                                "<span size=\"small\" weight=\"normal\">:%02u</span>",
+                                alarm->time/3600, alarm->time%3600/60, alarm->time%60);
+
+  return row->time;
+}
+
+static const gchar*
+alarm_store_get_color_markup(AlarmStore *store, Alarm *alarm)
+{
+  AlarmRow *row = alarm_store_get_row(store, alarm);
+
+  /* Setting color through markup preserves proper color on item selection (as
+   * opposed to setting it through cell renderer background property). */
+  if (!row->color_cached && alarm->color)
+    // NOTE: send PR with proper double->int conversion to gdk_rgba_to_string
+    row->color = g_strdup_printf("<span size=\"x-large\" foreground=\"#%02x%02x%02x\">"
+                                 UNICODE_BLOCK "</span>",
+                                 CLAMP((gint) alarm->color->red*256, 0, 255),
+                                 CLAMP((gint) alarm->color->green*256, 0, 255),
+                                 CLAMP((gint) alarm->color->blue*256, 0, 255));
+  row->color_cached = TRUE;
+
+  return row->color;
+}
+
+
+// GtkTreeModel interface
+static GtkTreeModelFlags
+alarm_store_get_flags(GtkTreeModel *model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+alarm_store_get_n_columns(GtkTreeModel *model)
+{
+  return AM_COL_COUNT;
+}
+
+static GType
+alarm_store_get_column_type(GtkTreeModel *model, gint index)
+{
+  g_return_val_if_fail(index >= 0 && index < AM_COL_COUNT, G_TYPE_INVALID);
+
+  return index == AM_COL_DATA ? G_TYPE_POINTER : G_TYPE_STRING;
+}
+
+static gboolean
+alarm_store_get_iter(GtkTreeModel *model, GtkTreeIter *iter, GtkTreePath *path)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(model);
+  Alarm *alarm;
+
+  g_return_val_if_fail(gtk_tree_path_get_depth(path) == 1, FALSE);
+
+  alarm = alarm_list_get(store->context, gtk_tree_path_get_indices(path)[0]);
+  if (alarm == NULL)
+    return FALSE;
+
+  alarm_store_set_iter(store, iter, alarm);
+  return TRUE;
+}
+
+static GtkTreePath*
+alarm_store_get_path(GtkTreeModel *model, GtkTreeIter *iter)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(model);
+
+  g_return_val_if_fail(VALID_ITER(store, iter), NULL);
+
+  return alarm_store_path_for_alarm(iter->user_data);
+}
+
+static void
+alarm_store_get_value(GtkTreeModel *model, GtkTreeIter *iter, gint column, GValue *value)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(model);
+  Alarm *alarm;
+
+  g_return_if_fail(VALID_ITER(store, iter));
+  g_return_if_fail(column >= 0 && column < AM_COL_COUNT);
+
+  alarm = iter->user_data;
+  g_value_init(value, alarm_store_get_column_type(model, column));
+
+  switch (column)
+  {
+    case AM_COL_DATA:
+      g_value_set_pointer(value, alarm);
+      break;
+
+    case AM_COL_ICON_NAME:
+      g_value_set_static_string(value, alarm_type_icons[alarm->type]);
+      break;
+
+    case AM_COL_TIME:
+      g_value_set_string(value, alarm_store_get_time_markup(store, alarm));
+      break;
+
+    case AM_COL_COLOR:
+      g_value_set_string(value, alarm_store_get_color_markup(store, alarm));
+      break;
+
+    case AM_COL_NAME:
+      g_value_set_string(value, alarm->name);
+      break;
+  }
+}
+
+static gboolean
+alarm_store_iter_next(GtkTreeModel *model, GtkTreeIter *iter)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(model);
+  Alarm *alarm;
+
+  g_return_val_if_fail(VALID_ITER(store, iter), FALSE);
+
+  alarm = alarm_list_get(store->context, ((Alarm*) iter->user_data)->position + 1);
+  if (alarm == NULL)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  iter->user_data = alarm;
+  return TRUE;
+}
+
+static gboolean
+alarm_store_iter_previous(GtkTreeModel *model, GtkTreeIter *iter)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(model);
+  guint position;
+
+  g_return_val_if_fail(VALID_ITER(store, iter), FALSE);
+
+  position = ((Alarm*) iter->user_data)->position;
+  if (position == 0)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  iter->user_data = alarm_list_get(store->context, position - 1);
+  return TRUE;
+}
+
+static gboolean
+alarm_store_iter_nth_child(GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent,
+                           gint n)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(model);
+  Alarm *alarm;
+
+  if (parent != NULL || n < 0)
+    return FALSE;
+
+  alarm = alarm_list_get(store->context, n);
+  if (alarm == NULL)
+    return FALSE;
+
+  alarm_store_set_iter(store, iter, alarm);
+  return TRUE;
+}
+
+static gboolean
+alarm_store_iter_children(GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+  return alarm_store_iter_nth_child(model, iter, parent, 0);
+}
+
+static gboolean
+alarm_store_iter_has_child(GtkTreeModel *model, GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+static gint
+alarm_store_iter_n_children(GtkTreeModel *model, GtkTreeIter *iter)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(model);
+
+  return iter == NULL ? (gint) store->context->alarms->len : 0;
+}
+
+static gboolean
+alarm_store_iter_parent(GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+static void
+alarm_store_tree_model_init(GtkTreeModelIface *iface)
+{
+  iface->get_flags = alarm_store_get_flags;
+  iface->get_n_columns = alarm_store_get_n_columns;
+  iface->get_column_type = alarm_store_get_column_type;
+  iface->get_iter = alarm_store_get_iter;
+  iface->get_path = alarm_store_get_path;
+  iface->get_value = alarm_store_get_value;
+  iface->iter_next = alarm_store_iter_next;
+  iface->iter_previous = alarm_store_iter_previous;
+  iface->iter_children = alarm_store_iter_children;
+  iface->iter_has_child = alarm_store_iter_has_child;
+  iface->iter_n_children = alarm_store_iter_n_children;
+  iface->iter_nth_child = alarm_store_iter_nth_child;
+  iface->iter_parent = alarm_store_iter_parent;
+}
+
+
+// GtkTreeDragSource/GtkTreeDragDest interfaces
+static gboolean
+alarm_store_row_draggable(GtkTreeDragSource *source, GtkTreePath *path)
+{
+  return TRUE;
+}
+
+static gboolean
+alarm_store_drag_data_get(GtkTreeDragSource *source, GtkTreePath *path,
+                          GtkSelectionData *selection_data)
+{
+  return gtk_tree_set_row_drag_data(selection_data, GTK_TREE_MODEL(source), path);
+}
+
+static gboolean
+alarm_store_drag_data_delete(GtkTreeDragSource *source, GtkTreePath *path)
+{
+  // Row has been moved in place on drop already
+  return TRUE;
+}
+
+static void
+alarm_store_drag_source_init(GtkTreeDragSourceIface *iface)
+{
+  iface->row_draggable = alarm_store_row_draggable;
+  iface->drag_data_get = alarm_store_drag_data_get;
+  iface->drag_data_delete = alarm_store_drag_data_delete;
+}
+
+static gboolean
+alarm_store_row_drop_possible(GtkTreeDragDest *dest, GtkTreePath *dest_path,
+                              GtkSelectionData *selection_data)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(dest);
+  GtkTreeModel *src_model;
+  GtkTreePath *src_path;
+  gboolean possible;
+
+  if (!gtk_tree_get_row_drag_data(selection_data, &src_model, &src_path))
+    return FALSE;
+  gtk_tree_path_free(src_path);
+
+  possible = src_model == GTK_TREE_MODEL(dest) &&
+             gtk_tree_path_get_depth(dest_path) == 1 &&
+             gtk_tree_path_get_indices(dest_path)[0] <= (gint) store->context->alarms->len;
+  return possible;
+}
+
+/* Dragged alarm is moved within AlarmContext.alarms and views are notified
+ * with single rows-reordered, instead of row insert and delete pair. */
+static gboolean
+alarm_store_drag_data_received(GtkTreeDragDest *dest, GtkTreePath *dest_path,
+                               GtkSelectionData *selection_data)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(dest);
+  GtkTreeModel *src_model;
+  GtkTreePath *src_path, *root;
+  Alarm *alarm;
+  guint from, to, i;
+  gint *new_order;
+
+  if (!alarm_store_row_drop_possible(dest, dest_path, selection_data))
+    return FALSE;
+  g_return_val_if_fail(gtk_tree_get_row_drag_data(selection_data, &src_model, &src_path),
+                       FALSE);
+
+  from = gtk_tree_path_get_indices(src_path)[0];
+  to = gtk_tree_path_get_indices(dest_path)[0];
+  gtk_tree_path_free(src_path);
+  // Destination path points before the row at which alarm is dropped
+  if (from < to)
+    to--;
+
+  alarm = alarm_list_get(store->context, from);
+  g_return_val_if_fail(alarm != NULL, FALSE);
+  if (from == to)
+    return TRUE;
+
+  alarm_list_move(store->context, alarm, to);
+
+  new_order = g_new(gint, store->context->alarms->len);
+  for (i = 0; i < store->context->alarms->len; i++)
+    new_order[i] = i;
+  for (i = MIN(from, to); i <= MAX(from, to); i++)
+    new_order[i] = from < to ? i + 1 : i - 1;
+  new_order[to] = from;
+
+  root = gtk_tree_path_new();
+  gtk_tree_model_rows_reordered(GTK_TREE_MODEL(store), root, NULL, new_order);
+  gtk_tree_path_free(root);
+  g_free(new_order);
+
+  return TRUE;
+}
+
+static void
+alarm_store_drag_dest_init(GtkTreeDragDestIface *iface)
+{
+  iface->drag_data_received = alarm_store_drag_data_received;
+  iface->row_drop_possible = alarm_store_row_drop_possible;
+}
+
+
+// GObject definition
+static void
+alarm_store_finalize(GObject *object)
+{
+  AlarmStore *store = ALARM_PLUGIN_ALARM_STORE(object);
+
+  if (store->changed_source_id)
+    g_source_remove(store->changed_source_id);
+  g_hash_table_destroy(store->changed_rows);
+  g_hash_table_destroy(store->rows);
+
+  G_OBJECT_CLASS(alarm_store_parent_class)->finalize(object);
+}
+
+static void
+alarm_store_class_init(AlarmStoreClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->finalize = alarm_store_finalize;
+}
+
+static void
+alarm_store_init(AlarmStore *store)
+{
+  do
+    store->stamp = g_random_int();
+  while (store->stamp == 0);
+
+  store->rows = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify) alarm_row_free);
+  store->changed_rows = g_hash_table_new(NULL, NULL);
+  store->changed_source_id = 0;
+}
+
+
+// External interface
+AlarmStore*
+alarm_store_new(AlarmContext *context)
+{
+  AlarmStore *store;
+
+  g_return_val_if_fail(context != NULL, NULL);
+
+  store = g_object_new(ALARM_PLUGIN_TYPE_ALARM_STORE, NULL);
+  store->context = context;
+
+  return store;
+}
+
+// Appends alarm to AlarmContext.alarms, transferring reference
+void
+alarm_store_append(AlarmStore *store, Alarm *alarm)
+{
+  GtkTreeIter iter;
+  GtkTreePath *path;
+
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM_STORE(store));
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+
+  alarm_list_append(store->context, alarm);
+
+  alarm_store_set_iter(store, &iter, alarm);
+  path = alarm_store_path_for_alarm(alarm);
+  gtk_tree_model_row_inserted(GTK_TREE_MODEL(store), path, &iter);
+  gtk_tree_path_free(path);
+}
+
+// Removes alarm from AlarmContext.alarms, transferring reference to caller
+void
+alarm_store_remove(AlarmStore *store, Alarm *alarm)
+{
+  GtkTreePath *path;
+
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM_STORE(store));
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+
+  path = alarm_store_path_for_alarm(alarm);
+  g_hash_table_remove(store->changed_rows, alarm);
+  g_hash_table_remove(store->rows, alarm);
+  alarm_list_remove(store->context, alarm);
+  gtk_tree_model_row_deleted(GTK_TREE_MODEL(store), path);
+  gtk_tree_path_free(path);
+}
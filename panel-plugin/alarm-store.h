@@ -0,0 +1,46 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_ALARM_STORE_H__
+#define __ALARM_PLUGIN_ALARM_STORE_H__
+
+G_BEGIN_DECLS
+
+// Column numbers are used in .glade - update if changed
+enum AlarmColumns
+{
+  AM_COL_DATA,
+  AM_COL_ICON_NAME,
+  AM_COL_TIME,
+  AM_COL_COLOR,
+  AM_COL_NAME,
+  AM_COL_COUNT
+};
+
+
+#define ALARM_PLUGIN_TYPE_ALARM_STORE (alarm_store_get_type())
+G_DECLARE_FINAL_TYPE(AlarmStore, alarm_store, ALARM_PLUGIN, ALARM_STORE, GObject)
+
+AlarmStore* alarm_store_new(AlarmContext *context);
+
+void alarm_store_append(AlarmStore *store, Alarm *alarm);
+void alarm_store_remove(AlarmStore *store, Alarm *alarm);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_ALARM_STORE_H__ */
@@ -20,13 +20,24 @@
 #include <config.h>
 #endif
 
-#include <libxfce4panel/xfce-panel-plugin.h>
+#include <gtk/gtk.h>
 #include <xfconf/xfconf.h>
 
-#include "common.h"
 #include "alert.h"
-#include "alarm-plugin.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "xfconf-batch.h"
+#include "sound-player.h"
+#include "notification.h"
+#include "alert-executor.h"
+#include "alert-coalescer.h"
+#include "journal.h"
+#include "rerun.h"
+#include "alarm-context.h"
 #include "alarm.h"
+#include "recurrence.h"
+#include "tracing.h"
 
 enum AlarmProperties
 {
@@ -43,6 +54,7 @@ enum AlarmProperties
   ALARM_PROP_RERUN_MODE,
   ALARM_PROP_TRIGGERED_TIMER,
   ALARM_PROP_STARTED_AT,
+  ALARM_PROP_DEADLINE,
   ALARM_PROP_COUNT
 };
 
@@ -122,6 +134,10 @@ alarm_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *ps
       g_value_set_boxed(value, self->started_at);
       break;
 
+    case ALARM_PROP_DEADLINE:
+      g_value_set_boxed(value, self->deadline);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
   }
@@ -132,6 +148,7 @@ alarm_set_property(GObject *object, guint prop_id, const GValue *value, GParamSp
 {
   Alarm *self = ALARM_PLUGIN_ALARM(object);
   GdkRGBA *color;
+  GDateTime *started_at;
 
   switch (prop_id)
   {
@@ -180,13 +197,15 @@ alarm_set_property(GObject *object, guint prop_id, const GValue *value, GParamSp
       break;
 
     case ALARM_PROP_TRIGGERED_TIMER:
-      // FIXME: ref/unref
+      // Not referenced - timer is owned by AlarmContext.alarms
       self->triggered_timer = g_value_get_object(value);
       break;
 
     case ALARM_PROP_STARTED_AT:
-      g_date_time_unref(self->started_at);
-      self->started_at = g_date_time_ref(g_value_get_boxed(value));
+      g_clear_pointer(&self->started_at, g_date_time_unref);
+      started_at = g_value_get_boxed(value);
+      if (started_at)
+        self->started_at = g_date_time_ref(started_at);
       break;
 
     default:
@@ -208,9 +227,10 @@ alarm_finalize(GObject *object)
 
   g_free(alarm->name);
   gdk_rgba_free(alarm->color);
-  g_object_unref(alarm->triggered_timer);
-  g_date_time_unref(alarm->started_at);
-  g_object_unref(alarm->alert);
+  g_clear_pointer(&alarm->started_at, g_date_time_unref);
+  g_clear_object(&alarm->alert);
+  g_clear_pointer(&alarm->deadline, g_date_time_unref);
+  g_clear_pointer(&alarm->period_start, g_date_time_unref);
 
   G_OBJECT_CLASS(alarm_parent_class)->finalize(object);
 }
@@ -256,7 +276,12 @@ alarm_class_init(AlarmClass *klass)
                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   alarm_class_props[ALARM_PROP_STARTED_AT] =
     g_param_spec_boxed("started-at", NULL, NULL, G_TYPE_DATE_TIME,
-                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       XFCONF_BATCH_PARAM_RUNTIME);
+  alarm_class_props[ALARM_PROP_DEADLINE] =
+    g_param_spec_boxed("deadline", NULL, NULL, G_TYPE_DATE_TIME,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS |
+                       G_PARAM_EXPLICIT_NOTIFY | XFCONF_BATCH_PARAM_RUNTIME);
 
   gobject_class->get_property = alarm_get_property;
   gobject_class->set_property = alarm_set_property;
@@ -274,274 +299,934 @@ alarm_init(Alarm *alarm)
 
 
 // Utilities
+#define ALARM_PATH_PREFIX "/alarm-"
+#define DEFAULT_ALERT_PATH "/default-alert"
+#define LAZY_BINDING_PATH "/lazy-binding"
+#define COALESCE_WINDOW_PATH "/coalesce-window"
+
+/* Alarm order is persisted as sparse keys spaced by ORDER_KEY_GAP. Alarm
+ * moved between neighbours gets key from the middle of the gap, so reordering
+ * writes only moved alarm's key. All keys are renumbered once gap is exhausted. */
+#define ORDER_KEY_GAP (1 << 16)
+
 static gint
-alarm_order_func(gconstpointer left, gconstpointer right, gpointer positions)
+alarm_order_func(gconstpointer left, gconstpointer right)
 {
-  return GPOINTER_TO_UINT(g_hash_table_lookup(positions, left)) -
-         GPOINTER_TO_UINT(g_hash_table_lookup(positions, right));
+  // GPtrArray passes pointers to elements
+  guint left_order = (*(Alarm**) left)->order;
+  guint right_order = (*(Alarm**) right)->order;
+
+  return (left_order > right_order) - (left_order < right_order);
 }
 
-GList*
-load_alarm_settings(AlarmPlugin *plugin)
+static void
+renumber_alarms(AlarmContext *context, guint from, guint to)
+{
+  for (guint i = from; i < MIN(to, context->alarms->len); i++)
+    ((Alarm*) g_ptr_array_index(context->alarms, i))->position = i;
+}
+
+static void
+save_alarm_order(AlarmContext *context, Alarm *alarm)
+{
+  gchar *property;
+
+  // Unsaved alarm will have its order key written along with other settings
+  if (alarm->id == ALARM_ID_UNASSIGNED || context->settings == NULL)
+    return;
+
+  property = g_strdup_printf("%s/alarm-%u",
+                             context->property_base,
+                             alarm->id);
+  xfconf_batch_set_uint(context->settings, property, alarm->order);
+  g_free(property);
+}
+
+// Respaces all keys evenly; unchanged keys are skipped by batch
+static void
+renumber_order_keys(AlarmContext *context)
 {
-  XfcePanelPlugin *panel_plugin = XFCE_PANEL_PLUGIN(plugin);
-  XfconfChannel *channel;
-  gchar *plugin_prop_base, *alarm_strid, *property_path;
-  gpointer property_value;
-  guint plugin_prop_base_len, alarm_id;
-  gint scanned_length;
-  GHashTable *alarm_properties, *alarms, *positions, *triggered_timers;
-  GHashTableIter ht_iter;
   Alarm *alarm;
-  GList *alarm_list;
 
-  g_return_val_if_fail(XFCE_IS_ALARM_PLUGIN(plugin), NULL);
+  for (guint i = 0; i < context->alarms->len; i++)
+  {
+    alarm = g_ptr_array_index(context->alarms, i);
+    alarm->order = (i + 1) * ORDER_KEY_GAP;
+    save_alarm_order(context, alarm);
+  }
+}
 
-  plugin_prop_base = g_strconcat(xfce_panel_plugin_get_property_base(panel_plugin), "/",
-                                 NULL);
-  plugin_prop_base_len = strlen(plugin_prop_base);
+// Assigns key between neighbours of alarm at its current position
+static void
+assign_order_key(AlarmContext *context, Alarm *alarm)
+{
+  Alarm *prev, *next;
+  gint64 lower, upper;
 
-  // alarm->id => Alarm*
-  alarms = g_hash_table_new(g_int_hash, g_int_equal);
-  // Alarm* => position
-  positions = g_hash_table_new(NULL, NULL);
-  // Alarm* => triggered_timer->id
-  triggered_timers = g_hash_table_new(NULL, NULL);
+  prev = alarm->position ? g_ptr_array_index(context->alarms, alarm->position - 1) : NULL;
+  next = alarm_list_get(context, alarm->position + 1);
 
-  channel = xfce_panel_plugin_xfconf_channel_new(panel_plugin);
-  alarm_properties = xfconf_channel_get_properties(channel, "/");
-  g_object_unref(channel);
+  // Bounds are exclusive
+  lower = prev ? prev->order : 0;
+  upper = next ? next->order : (gint64) G_MAXUINT + 1;
 
-  g_hash_table_iter_init(&ht_iter, alarm_properties);
-  // property_path has form: /panel/plugin-ID[[/<alarm-ID>]/<property name>]
-  while (g_hash_table_iter_next(&ht_iter, (gpointer) &property_path, &property_value))
+  if (next == NULL && lower + ORDER_KEY_GAP < upper)
+    alarm->order = lower + ORDER_KEY_GAP;
+  else if (upper - lower > 1)
+    alarm->order = lower + (upper - lower) / 2;
+  else
   {
-    alarm_strid = property_path + plugin_prop_base_len;
-    if (strstr(property_path, plugin_prop_base) != property_path ||
-        strstr(property_path + plugin_prop_base_len, "/") != NULL ||
-        sscanf(alarm_strid, "alarm-%u%n", &alarm_id, &scanned_length) != 1 ||
-        (guint) scanned_length < strlen(alarm_strid))
-      continue;
+    renumber_order_keys(context);
+    return;
+  }
 
-    if (g_hash_table_contains(alarms, &alarm_id))
-    {
-      g_warn_if_reached();
-      continue;
-    }
+  save_alarm_order(context, alarm);
+}
 
-    channel = xfconf_channel_new_with_property_base(xfce_panel_get_channel_name(),
-                                                    property_path);
-    alarm = alarm_new(channel);
-    g_object_weak_ref(G_OBJECT(alarm), (GWeakNotify) G_CALLBACK(g_object_unref), channel);
+/* Parses alarm property path relative to plugin property base:
+ * /alarm-<ID>[/<property name>]. Returns pointer to the part following alarm
+ * id or NULL if path is not an alarm property. */
+static const gchar*
+parse_alarm_path(const gchar *path, guint *alarm_id)
+{
+  const gchar *id_str;
+  gchar *id_end;
+  guint64 id;
 
-    g_hash_table_insert(alarms, &alarm->id, alarm);
+  if (strncmp(path, ALARM_PATH_PREFIX, sizeof(ALARM_PATH_PREFIX) - 1))
+    return NULL;
 
-    alarm->id = alarm_id;
+  id_str = path + sizeof(ALARM_PATH_PREFIX) - 1;
+  if (!g_ascii_isdigit(*id_str))
+    return NULL;
 
-    g_hash_table_insert(positions, alarm,
-                        GUINT_TO_POINTER(g_value_get_uint(property_value)));
+  id = g_ascii_strtoull(id_str, &id_end, 10);
+  if (id == ALARM_ID_UNASSIGNED || id >= ALARM_ID_INVALID ||
+      (*id_end != '\0' && *id_end != '/'))
+    return NULL;
 
-    alarm_id = xfconf_channel_get_uint(channel, "triggered-timer", ALARM_ID_UNASSIGNED);
-    if (alarm_id != ALARM_ID_UNASSIGNED)
-      g_hash_table_insert(triggered_timers, alarm, GUINT_TO_POINTER(alarm_id));
+  *alarm_id = id;
+  return id_end;
+}
 
-    /*
-    if (!g_strcmp0(parts[2], "type"))
-      alarm->type = g_value_get_uint(property_value);
+static void
+set_property_from_xfconf(GObject *object, const gchar *property_name,
+                         const GValue *xfconf_value)
+{
+  GParamSpec *pspec;
+  GValue value = G_VALUE_INIT;
 
-    else if (!g_strcmp0(parts[2], "name"))
-      alarm->name = g_strdup(g_value_get_string(property_value));
+  pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(object), property_name);
+  if (pspec == NULL || (pspec->flags & G_PARAM_WRITABLE) == 0)
+  {
+    g_warning("Unknown alarm property: %s", property_name);
+    return;
+  }
 
-    else if (!g_strcmp0(parts[2], "time"))
-      alarm->time = g_value_get_uint(property_value);
+  g_value_init(&value, pspec->value_type);
+  if (xfconf_value_to_property(xfconf_value, &value))
+    g_object_set_property(object, property_name, &value);
+  else
+    g_warning("Invalid value of alarm property: %s", property_name);
+  g_value_unset(&value);
+}
+
+GPtrArray*
+load_alarm_settings(AlarmContext *context)
+{
+  XfconfChannel *channel;
+  const gchar *prop_base, *property_name;
+  gchar *property_path;
+  GValue *property_value;
+  gsize prop_base_len;
+  guint alarm_id;
+  gpointer triggered_timer_id;
+  GHashTable *alarm_properties, *triggered_timers;
+  GHashTableIter ht_iter;
+  Alarm *alarm;
+  GObject *object;
+  GPtrArray *alarms;
+  GList *alarm_list, *alarm_iter;
+  gint64 trace_start;
+
+  g_return_val_if_fail(context != NULL, NULL);
+
+  if (context->settings == NULL)
+    return g_ptr_array_new_with_free_func(g_object_unref);
+
+  TRACE_BEGIN(trace_start);
+
+  prop_base = context->property_base;
+  prop_base_len = strlen(prop_base);
 
-    else if (!g_strcmp0(parts[2], "color"))
+  // Alarm* => triggered_timer->id
+  triggered_timers = g_hash_table_new(NULL, NULL);
+
+  /* Only plugin's own subtree is fetched, in a single round trip. Alarms are
+   * populated directly from fetched values and these values become snapshot
+   * of persisted settings, so unchanged properties are never written back. */
+  profiler_enter(context->profiler, PROFILER_LOAD_SETTINGS);
+  channel = xfconf_channel_get(context->channel_name);
+  alarm_properties = xfconf_channel_get_properties(channel, prop_base);
+  profiler_count_calls(context->profiler, 1);
+
+  if (alarm_properties)
+    g_hash_table_iter_init(&ht_iter, alarm_properties);
+  /* property_path has form: /plugins/plugin-ID/alarm-ID[/alert]/<property name>
+   * or /plugins/plugin-ID/default-alert/<property name> */
+  while (alarm_properties &&
+         g_hash_table_iter_next(&ht_iter, (gpointer) &property_path,
+                                (gpointer) &property_value))
+  {
+    property_name = property_path + prop_base_len;
+    if (g_str_has_prefix(property_name, DEFAULT_ALERT_PATH "/"))
+    {
+      xfconf_batch_snapshot(context->settings, property_path, property_value);
+      set_property_from_xfconf(G_OBJECT(context->alert),
+                               property_name + strlen(DEFAULT_ALERT_PATH "/"),
+                               property_value);
+      continue;
+    }
+    else if (!g_strcmp0(property_name, LAZY_BINDING_PATH))
+    {
+      context->lazy_binding = G_VALUE_HOLDS_BOOLEAN(property_value) &&
+                             g_value_get_boolean(property_value);
+      continue;
+    }
+    else if (!g_strcmp0(property_name, COALESCE_WINDOW_PATH))
     {
-      if (gdk_rgba_parse(&color, g_value_get_string(property_value)))
-        alarm->color = gdk_rgba_copy(&color);
+      if (G_VALUE_HOLDS_UINT(property_value))
+        alert_coalescer_set_window(context->coalescer, g_value_get_uint(property_value));
+      continue;
     }
-    else if (!g_strcmp0(parts[2], "autostart"))
-      alarm->autostart = g_value_get_boolean(property_value);
 
-    else if (!g_strcmp0(parts[2], "autostop"))
-      alarm->autostop = g_value_get_boolean(property_value);
+    property_name = parse_alarm_path(property_name, &alarm_id);
+    if (property_name == NULL)
+      continue;
 
-    else if (!g_strcmp0(parts[2], "autostart-on-resume"))
-      alarm->autostart_on_resume = g_value_get_boolean(property_value);
+    alarm = lookup_alarm(context, alarm_id);
+    if (alarm == NULL)
+    {
+      alarm = alarm_new();
+      alarm->id = alarm_id;
+      g_hash_table_insert(context->alarm_ids, GUINT_TO_POINTER(alarm_id), alarm);
+      context->next_id = MAX(context->next_id, alarm_id + 1);
+    }
 
-    else if (!g_strcmp0(parts[2], "autostop-on-suspend"))
-      alarm->autostop_on_suspend = g_value_get_boolean(property_value);
+    xfconf_batch_snapshot(context->settings, property_path, property_value);
 
-    else if (!g_strcmp0(parts[2], "triggered-timer"))
-      g_hash_table_insert(triggered_timers, alarm,
-                          GUINT_TO_POINTER(g_value_get_uint(property_value)));
+    // Property of alarm itself stores alarm order key
+    if (*property_name == '\0')
+    {
+      if (G_VALUE_HOLDS_UINT(property_value))
+        alarm->order = g_value_get_uint(property_value);
+      continue;
+    }
+    property_name++;
 
-    else if (!g_strcmp0(parts[2], "rerun-every"))
-      alarm->rerun_every = g_value_get_int(property_value);
+    object = G_OBJECT(alarm);
+    if (g_str_has_prefix(property_name, "alert/"))
+    {
+      if (alarm->alert == NULL)
+        alarm->alert = alert_new();
+      object = G_OBJECT(alarm->alert);
+      property_name += strlen("alert/");
+    }
+    else if (!g_strcmp0(property_name, "triggered-timer"))
+    {
+      if (G_VALUE_HOLDS_UINT(property_value))
+        g_hash_table_insert(triggered_timers, alarm,
+                            GUINT_TO_POINTER(g_value_get_uint(property_value)));
+      continue;
+    }
+    else if (!g_strcmp0(property_name, "started-at"))
+    {
+      // Running state is kept in journal now - migrate and drop from xfconf
+      set_property_from_xfconf(object, property_name, property_value);
+      xfconf_batch_reset(context->settings, property_path, FALSE);
+      continue;
+    }
 
-    else if (!g_strcmp0(parts[2], "rerun-mode"))
-      alarm->rerun_mode = g_value_get_uint(property_value);
-    */
+    set_property_from_xfconf(object, property_name, property_value);
   }
-  g_free(plugin_prop_base);
-  g_hash_table_destroy(alarm_properties);
+  if (alarm_properties)
+    g_hash_table_destroy(alarm_properties);
 
   /* TODO: consistency checks and coercion/alarm removal?
    * e.g. type/triggered-timer, type/rerun-every, rerun-every/rerun-mode */
 
   g_hash_table_iter_init(&ht_iter, triggered_timers);
-  while (g_hash_table_iter_next(&ht_iter, (gpointer) &alarm, (gpointer) &alarm_id))
+  while (g_hash_table_iter_next(&ht_iter, (gpointer) &alarm, &triggered_timer_id))
   {
-    alarm->triggered_timer = g_hash_table_lookup(alarms, &alarm_id);
+    alarm->triggered_timer = g_hash_table_lookup(context->alarm_ids, triggered_timer_id);
     g_warn_if_fail(alarm->triggered_timer != NULL);
   }
   g_hash_table_destroy(triggered_timers);
 
-  alarm_list = g_hash_table_get_values(alarms);
-  g_hash_table_destroy(alarms);
+  alarms = g_ptr_array_new_full(g_hash_table_size(context->alarm_ids), g_object_unref);
+  alarm_list = g_hash_table_get_values(context->alarm_ids);
+  for (alarm_iter = alarm_list; alarm_iter; alarm_iter = alarm_iter->next)
+    g_ptr_array_add(alarms, alarm_iter->data);
+  g_list_free(alarm_list);
+
+  g_ptr_array_sort(alarms, alarm_order_func);
+  for (guint i = 0; i < alarms->len; i++)
+    ((Alarm*) g_ptr_array_index(alarms, i))->position = i;
+  profiler_leave(context->profiler, PROFILER_LOAD_SETTINGS);
+  TRACE_END(trace_start, "load settings", "%u alarms", alarms->len);
 
-  alarm_list = g_list_sort_with_data(alarm_list, alarm_order_func, positions);
-  g_hash_table_destroy(positions);
-  return alarm_list;
+  return alarms;
 }
 
 void
-save_alarm_settings(AlarmPlugin *plugin, Alarm *alarm)
+save_alarm_settings(AlarmContext *context, Alarm *alarm)
 {
-  XfcePanelPlugin *panel_plugin = XFCE_PANEL_PLUGIN(plugin);
-  XfconfChannel *channel;
-  GList *alarm_iter;
-  gint position;
-  gchar *property_base, *alarm_strid;
-  guint last_id;
+  gchar *property_base, *property;
+  gint64 trace_start;
 
+  g_return_if_fail(context != NULL);
   g_return_if_fail(alarm != NULL);
 
+  TRACE_BEGIN(trace_start);
+
+  // Ids are never reused, so stale references to removed alarm cannot resolve
   if (alarm->id == ALARM_ID_UNASSIGNED)
   {
-    last_id = ALARM_ID_UNASSIGNED;
-    alarm_iter = plugin->alarms;
-    while (alarm_iter)
-    {
-      last_id = MAX(((Alarm*) alarm_iter->data)->id, last_id);
-      alarm_iter = alarm_iter->next;
-    }
-    alarm->id = last_id + 1;
+    g_return_if_fail(context->next_id < ALARM_ID_INVALID);
+    alarm->id = context->next_id++;
+    g_hash_table_insert(context->alarm_ids, GUINT_TO_POINTER(alarm->id), alarm);
   }
 
-  g_return_if_fail(XFCE_IS_ALARM_PLUGIN(plugin));
+  // Without persistence saving only assigns id
+  if (context->settings == NULL)
+  {
+    g_hash_table_remove(context->dirty_alarms, alarm);
+    return;
+  }
+
+  profiler_enter(context->profiler, PROFILER_SAVE_SETTINGS);
+
+  /* Only properties changed since last save are written, and all writes are
+   * deferred to a single flush in the next main loop iteration. */
+  property_base = g_strdup_printf("%s/alarm-%u",
+                                  context->property_base,
+                                  alarm->id);
+
+  g_warn_if_fail(alarm_list_get(context, alarm->position) == alarm);
+  xfconf_batch_set_uint(context->settings, property_base, alarm->order);
+
+  xfconf_batch_set_object(context->settings, property_base, G_OBJECT(alarm));
+
+  property = g_strconcat(property_base, "/triggered-timer", NULL);
+  if (alarm->triggered_timer)
+    xfconf_batch_set_uint(context->settings, property, alarm->triggered_timer->id);
+  else
+    xfconf_batch_reset(context->settings, property, FALSE);
+  g_free(property);
+
+  property = g_strconcat(property_base, "/alert", NULL);
+  if (alarm->alert)
+    xfconf_batch_set_object(context->settings, property, G_OBJECT(alarm->alert));
+  else
+    xfconf_batch_reset(context->settings, property, TRUE);
+  g_free(property);
 
-  alarm_strid = g_strdup_printf("alarm-%u", alarm->id);
-  property_base = g_strconcat(xfce_panel_plugin_get_property_base(panel_plugin), "/",
-                              alarm_strid, NULL);
-  g_free(alarm_strid);
-  channel = xfconf_channel_new_with_property_base(xfce_panel_get_channel_name(),
-                                                  property_base);
   g_free(property_base);
+  profiler_leave(context->profiler, PROFILER_SAVE_SETTINGS);
+  TRACE_END(trace_start, "save settings", "alarm %u", alarm->id);
+
+  // May release the last reference, so alarm is not touched afterwards
+  g_hash_table_remove(context->dirty_alarms, alarm);
+}
+
+// Saves alarms whose settings changed since they were last saved
+void
+save_dirty_alarms(AlarmContext *context)
+{
+  GHashTableIter ht_iter;
+  gpointer alarm;
 
-  xfconf_channel_reset_property(channel, NULL, TRUE);
+  g_return_if_fail(context != NULL);
 
-  position = g_list_index(plugin->alarms, alarm);
-  if (position == -1)
+  if (context->save_id)
+    g_source_remove(context->save_id);
+  context->save_id = 0;
+
+  // Saving removes alarm from the set, which invalidates iterator
+  while (g_hash_table_size(context->dirty_alarms))
   {
-    g_warn_if_reached();
-    position = g_list_length(plugin->alarms);
+    g_hash_table_iter_init(&ht_iter, context->dirty_alarms);
+    g_hash_table_iter_next(&ht_iter, &alarm, NULL);
+    save_alarm_settings(context, alarm);
   }
-  g_warn_if_fail(xfconf_channel_set_uint(channel, "", position));
+}
 
-  xfconf_channel_set_object(channel, NULL, G_OBJECT(alarm));
-  if (alarm->alert)
-    xfconf_channel_set_object(channel, "/alert", G_OBJECT(alarm->alert));
+void
+reset_alarm_settings(AlarmContext *context, Alarm *alarm)
+{
+  gchar *property;
+
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(alarm != NULL);
+  g_return_if_fail(alarm->id != ALARM_ID_UNASSIGNED);
+
+  profiler_enter(context->profiler, PROFILER_RESET_SETTINGS);
+  if (context->settings)
+  {
+    property = g_strdup_printf("%s/alarm-%u", context->property_base, alarm->id);
+    xfconf_batch_reset(context->settings, property, TRUE);
+    g_free(property);
+  }
+
+  g_hash_table_remove(context->alarm_ids, GUINT_TO_POINTER(alarm->id));
+  g_hash_table_remove(context->dirty_alarms, alarm);
 
-  g_object_unref(channel);
+  profiler_leave(context->profiler, PROFILER_RESET_SETTINGS);
 }
 
+/* Alarms are stored in contiguous array. Every alarm knows its position, so
+ * position lookup is O(1) and changes only renumber the shifted range. */
 void
-save_alarm_positions(AlarmPlugin *plugin, GList *alarm_iter_from, GList *alarm_iter_to)
+alarm_list_append(AlarmContext *context, Alarm *alarm)
 {
-  XfcePanelPlugin *panel_plugin = XFCE_PANEL_PLUGIN(plugin);
-  XfconfChannel *channel;
-  gchar *property_base, *alarm_strid;
-  GList *alarm_iter;
-  Alarm *alarm;
-  gint position;
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
 
-  g_return_if_fail(XFCE_IS_ALARM_PLUGIN(plugin));
-  g_return_if_fail(alarm_iter_from != NULL);
-  g_return_if_fail(alarm_iter_from != alarm_iter_to);
+  alarm->position = context->alarms->len;
+  g_ptr_array_add(context->alarms, alarm);
+  assign_order_key(context, alarm);
+}
 
-  position = g_list_position(plugin->alarms, alarm_iter_from);
-  g_return_if_fail(position != -1);
+/* Removes alarm from list, transferring list's reference to caller. Keys of
+ * remaining alarms stay ordered, so nothing has to be written. */
+void
+alarm_list_remove(AlarmContext *context, Alarm *alarm)
+{
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+  g_return_if_fail(alarm_list_get(context, alarm->position) == alarm);
 
-  property_base = g_strconcat(xfce_panel_plugin_get_property_base(panel_plugin), "/", NULL);
-  channel = xfconf_channel_new_with_property_base(xfce_panel_get_channel_name(),
-                                                  property_base);
+  g_ptr_array_steal_index(context->alarms, alarm->position);
+  renumber_alarms(context, alarm->position, context->alarms->len);
+}
+
+void
+alarm_list_move(AlarmContext *context, Alarm *alarm, guint position)
+{
+  guint old_position;
+
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+  g_return_if_fail(alarm_list_get(context, alarm->position) == alarm);
+  g_return_if_fail(position < context->alarms->len);
+
+  old_position = alarm->position;
+  if (old_position == position)
+    return;
+
+  profiler_enter(context->profiler, PROFILER_MOVE_ALARM);
+  g_ptr_array_steal_index(context->alarms, old_position);
+  g_ptr_array_insert(context->alarms, position, alarm);
+  renumber_alarms(context, MIN(old_position, position), MAX(old_position, position) + 1);
+  assign_order_key(context, alarm);
+  profiler_leave(context->profiler, PROFILER_MOVE_ALARM);
+}
+
+Alarm*
+alarm_list_get(AlarmContext *context, guint position)
+{
+  g_return_val_if_fail(context != NULL, NULL);
+
+  if (position >= context->alarms->len)
+    return NULL;
+
+  return g_ptr_array_index(context->alarms, position);
+}
+
+Alarm*
+lookup_alarm(AlarmContext *context, guint alarm_id)
+{
+  g_return_val_if_fail(context != NULL, NULL);
+
+  return g_hash_table_lookup(context->alarm_ids, GUINT_TO_POINTER(alarm_id));
+}
+
+
+// Settings binding
+/* Binding keeps object in sync with xfconf in both directions: external
+ * changes are applied to object and object changes are written through
+ * XfconfBatch. It requires just one signal handler per direction, instead of
+ * a pair of handlers per property. */
+static void
+settings_property_changed(XfconfChannel *channel, const gchar *property,
+                          const GValue *value, GObject *object)
+{
+  AlarmContext *context = g_object_get_data(G_OBJECT(channel), "context");
+  gchar *property_base, *property_path;
+  const gchar *property_name = property + 1;
+  Alarm *alarm;
+
+  g_return_if_fail(context != NULL);
+
+  g_object_get(channel, "property-base", &property_base, NULL);
+  property_path = g_strconcat(property_base, property, NULL);
   g_free(property_base);
+  // Incoming value is persisted already - prevent writing it back
+  xfconf_batch_snapshot(context->settings, property_path, G_IS_VALUE(value) ? value : NULL);
+  g_free(property_path);
+
+  if (!G_IS_VALUE(value))
+    return;
 
-  alarm_iter = alarm_iter_from;
-  while (alarm_iter && (alarm_iter != alarm_iter_to))
+  if (ALARM_PLUGIN_IS_ALARM(object))
   {
-    alarm = alarm_iter->data;
+    alarm = ALARM_PLUGIN_ALARM(object);
 
-    if (alarm->id != ALARM_ID_UNASSIGNED)
+    if (g_str_has_prefix(property_name, "alert/"))
     {
-      alarm_strid = g_strdup_printf("alarm-%u", alarm->id);
-      g_warn_if_fail(xfconf_channel_set_uint(channel, alarm_strid, position));
-      g_free(alarm_strid);
+      if (alarm->alert == NULL)
+        return;
+      object = G_OBJECT(alarm->alert);
+      property_name += strlen("alert/");
     }
-    else
-      g_warn_if_reached();
+    else if (!g_strcmp0(property_name, "triggered-timer"))
+    {
+      if (!G_VALUE_HOLDS_UINT(value))
+        return;
 
-    alarm_iter = alarm_iter->next;
-    position++;
+      g_object_set(alarm, "triggered-timer", lookup_alarm(context, g_value_get_uint(value)),
+                   NULL);
+      return;
+    }
   }
-  g_warn_if_fail(alarm_iter == alarm_iter_to);
 
-  g_object_unref(channel);
+  set_property_from_xfconf(object, property_name, value);
 }
 
-void
-reset_alarm_settings(AlarmPlugin *plugin, Alarm *alarm)
+static gboolean
+save_dirty_idle(gpointer data)
+{
+  AlarmContext *context = data;
+
+  context->save_id = 0;
+  save_dirty_alarms(context);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Dialogs apply settings property by property, so alarm is only marked dirty
+ * here and saved once, after all notifications of main loop iteration. */
+static void
+alarm_notify(Alarm *alarm, GParamSpec *pspec, AlarmContext *context)
+{
+  // Runtime state is journaled by start_alarm()/stop_alarm()
+  if (pspec->flags & XFCONF_BATCH_PARAM_RUNTIME)
+    return;
+
+  g_hash_table_add(context->dirty_alarms, g_object_ref(alarm));
+  if (context->save_id == 0)
+    context->save_id = g_idle_add(save_dirty_idle, context);
+}
+
+static void
+default_alert_notify(Alert *alert, GParamSpec *pspec, AlarmContext *context)
+{
+  gchar *property_base;
+
+  property_base = g_strconcat(context->property_base,
+                              DEFAULT_ALERT_PATH, NULL);
+  xfconf_batch_set_object(context->settings, property_base, G_OBJECT(alert));
+  g_free(property_base);
+}
+
+static void
+bind_settings(AlarmContext *context, GObject *object, const gchar *property_base,
+              GCallback notify_callback)
 {
-  XfcePanelPlugin *panel_plugin = XFCE_PANEL_PLUGIN(plugin);
   XfconfChannel *channel;
-  gchar *property_base, *alarm_strid;
 
-  g_return_if_fail(XFCE_IS_ALARM_PLUGIN(plugin));
-  g_return_if_fail(alarm != NULL);
-  g_return_if_fail(alarm->id != ALARM_ID_UNASSIGNED);
+  if (context->settings == NULL || g_object_get_data(object, "settings-channel") != NULL)
+    return;
 
-  property_base = g_strconcat(xfce_panel_plugin_get_property_base(panel_plugin), "/", NULL);
-  channel = xfconf_channel_new_with_property_base(xfce_panel_get_channel_name(),
+  channel = xfconf_channel_new_with_property_base(context->channel_name,
                                                   property_base);
+  g_object_set_data(G_OBJECT(channel), "context", context);
+  g_signal_connect_object(channel, "property-changed",
+                          G_CALLBACK(settings_property_changed), object, 0);
+  g_signal_connect(object, "notify", notify_callback, context);
+  g_object_set_data_full(object, "settings-channel", channel, g_object_unref);
+}
+
+/* In lazy binding mode alarm is bound only once it is edited or started.
+ * Otherwise all alarms are bound right after loading. */
+void
+bind_alarm_settings(AlarmContext *context, Alarm *alarm)
+{
+  gchar *property_base;
+
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+  g_return_if_fail(alarm->id != ALARM_ID_UNASSIGNED);
+
+  property_base = g_strdup_printf("%s/alarm-%u",
+                                  context->property_base,
+                                  alarm->id);
+  bind_settings(context, G_OBJECT(alarm), property_base, G_CALLBACK(alarm_notify));
   g_free(property_base);
+}
+
+void
+bind_alert_settings(AlarmContext *context)
+{
+  gchar *property_base;
 
-  alarm_strid = g_strdup_printf("alarm-%u", alarm->id);
-  xfconf_channel_reset_property(channel, alarm_strid, TRUE);
-  g_free(alarm_strid);
+  g_return_if_fail(context != NULL);
 
-  g_object_unref(channel);
+  property_base = g_strconcat(context->property_base,
+                              DEFAULT_ALERT_PATH, NULL);
+  bind_settings(context, G_OBJECT(context->alert), property_base,
+                G_CALLBACK(default_alert_notify));
+  g_free(property_base);
 }
 
 
-// External interface
-Alarm*
-alarm_new(XfconfChannel *channel)
+// Runtime
+static GDateTime*
+alarm_deadline(Alarm *alarm, GDateTime *after)
 {
-  Alarm *alarm = g_object_new(ALARM_PLUGIN_TYPE_ALARM, NULL);
-  gint prop_id;
-  gchar *xfconf_prop;
-  GParamSpec *pspec;
+  g_return_val_if_fail(alarm->started_at != NULL, NULL);
+
+  if (alarm->type == ALARM_TYPE_TIMER)
+    return g_date_time_add_seconds(alarm->started_at, alarm->time);
+
+  return recurrence_next(alarm->time, alarm->rerun_every, alarm->rerun_mode,
+                         alarm->started_at, after);
+}
+
+// Start of interval ending at deadline: previous occurrence of recurring clock
+static GDateTime*
+alarm_period_start(Alarm *alarm)
+{
+  GDateTime *previous = NULL;
+
+  if (alarm->type == ALARM_TYPE_CLOCK && alarm->rerun_every != NO_RERUN)
+    previous = recurrence_previous(alarm->time, alarm->rerun_every, alarm->rerun_mode,
+                                   alarm->started_at, alarm->deadline);
+
+  return previous ? previous : g_date_time_ref(alarm->started_at);
+}
+
+static void
+journal_alarm(AlarmContext *context, Alarm *alarm, JournalEvent event)
+{
+  GDateTime *now;
+
+  if (context->journal == NULL || alarm->id == ALARM_ID_UNASSIGNED)
+    return;
+
+  if (event == JOURNAL_START)
+  {
+    journal_append(context->journal, event, alarm->id, alarm->started_at);
+    return;
+  }
+
+  now = clock_get_now(context->clock);
+  journal_append(context->journal, event, alarm->id, now);
+  g_date_time_unref(now);
+}
+
+static void alarm_expired(gpointer key, gpointer user_data);
+
+/* Deadline is scheduled as monotonic time, so wall clock adjustments while
+ * alarm is running do not shift it. */
+static void
+arm_alarm(AlarmContext *context, Alarm *alarm)
+{
+  GDateTime *now;
+  gint64 monotonic_deadline;
+
+  now = clock_get_now(context->clock);
+  monotonic_deadline = clock_get_monotonic_time(context->clock) +
+    g_date_time_difference(alarm->deadline, now);
+  g_date_time_unref(now);
+
+  // Reschedules in place if alarm is already scheduled - O(log n)
+  scheduler_add(context->scheduler, alarm, monotonic_deadline, alarm_expired, context);
+}
+
+static void
+schedule_alarm_after(AlarmContext *context, Alarm *alarm, GDateTime *after)
+{
+  GDateTime *deadline = NULL;
+  gboolean changed;
+
+  if (alarm->started_at)
+    deadline = alarm_deadline(alarm, after);
+
+  changed = deadline == NULL || alarm->deadline == NULL ?
+    deadline != alarm->deadline : !g_date_time_equal(deadline, alarm->deadline);
+  g_clear_pointer(&alarm->deadline, g_date_time_unref);
+  g_clear_pointer(&alarm->period_start, g_date_time_unref);
+  alarm->deadline = deadline;
+
+  if (deadline == NULL)
+    scheduler_remove(context->scheduler, alarm);
+  else
+  {
+    alarm->period_start = alarm_period_start(alarm);
+    arm_alarm(context, alarm);
+  }
+
+  if (changed)
+    g_object_notify_by_pspec(G_OBJECT(alarm), alarm_class_props[ALARM_PROP_DEADLINE]);
+}
+
+static void
+alarm_expired(gpointer key, gpointer user_data)
+{
+  Alarm *alarm = ALARM_PLUGIN_ALARM(key);
+  AlarmContext *context = user_data;
+  GDateTime *fired_at, *now;
+  gint64 due;
+
+  // Lateness of this wakeup counts towards latency of alert
+  due = scheduler_get_time(context->scheduler);
+  if (alarm->deadline)
+  {
+    now = clock_get_now(context->clock);
+    due -= MAX(g_date_time_difference(now, alarm->deadline), 0);
+    g_date_time_unref(now);
+  }
+
+  journal_alarm(context, alarm, JOURNAL_FIRE);
+  alert_coalescer_add(context->coalescer, alarm, due, alarm->name,
+                      alarm->alert ? alarm->alert : context->alert);
+  if (alarm->type == ALARM_TYPE_CLOCK && alarm->rerun_every != NO_RERUN)
+  {
+    // Recurring clock keeps running until next occurrence
+    fired_at = g_date_time_ref(alarm->deadline);
+    schedule_alarm_after(context, alarm, fired_at);
+    g_date_time_unref(fired_at);
+  }
+  else
+    stop_alarm(context, alarm);
+}
+
+/* Fraction of current interval of running alarm that has passed. Recurring
+ * clock starts over from empty after every occurrence. */
+gdouble
+alarm_progress(Alarm *alarm, GDateTime *now)
+{
+  GTimeSpan total, elapsed;
+
+  g_return_val_if_fail(ALARM_PLUGIN_IS_ALARM(alarm), 0.0);
+
+  if (alarm->period_start == NULL || alarm->deadline == NULL)
+    return 0.0;
+
+  total = g_date_time_difference(alarm->deadline, alarm->period_start);
+  elapsed = g_date_time_difference(now, alarm->period_start);
+  if (total <= 0 || elapsed >= total)
+    return 1.0;
+
+  return elapsed > 0 ? (gdouble) elapsed / total : 0.0;
+}
+
+/* Synchronizes scheduler with alarm state. Has to be called whenever alarm is
+ * started, stopped or its settings are changed. Only this alarm's entry is
+ * updated - other alarms are not rescanned. */
+void
+schedule_alarm(AlarmContext *context, Alarm *alarm)
+{
+  GDateTime *now;
+
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+
+  if (alarm->started_at == NULL || alarm->rerun_every == NO_RERUN)
+  {
+    // One-off alarms expire once, even if deadline passed while panel was down
+    schedule_alarm_after(context, alarm, alarm->started_at);
+    return;
+  }
 
-  if (channel)
-    for (prop_id = 1; prop_id < ALARM_PROP_COUNT; prop_id++)
+  now = clock_get_now(context->clock);
+  schedule_alarm_after(context, alarm,
+                       g_date_time_compare(now, alarm->started_at) > 0 ?
+                       now : alarm->started_at);
+  g_date_time_unref(now);
+}
+
+/* Monotonic clock stands still during suspend, so after resume deadline of
+ * running alarm is measured again against wall clock. Deadline passed while
+ * suspended is kept (not advanced to next recurrence), so alarm fires at once,
+ * together with all other alarms missed. */
+void
+resume_alarm(AlarmContext *context, Alarm *alarm)
+{
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+
+  if (alarm->deadline == NULL)
+  {
+    schedule_alarm(context, alarm);
+    return;
+  }
+
+  arm_alarm(context, alarm);
+}
+
+void
+start_alarm(AlarmContext *context, Alarm *alarm)
+{
+  GDateTime *now;
+
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+
+  if (alarm->id != ALARM_ID_UNASSIGNED)
+    bind_alarm_settings(context, alarm);
+
+  now = clock_get_now(context->clock);
+  g_object_set(alarm, "started-at", now, NULL);
+  g_date_time_unref(now);
+  journal_alarm(context, alarm, JOURNAL_START);
+
+  schedule_alarm(context, alarm);
+}
+
+void
+stop_alarm(AlarmContext *context, Alarm *alarm)
+{
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+
+  if (alarm->started_at != NULL)
+  {
+    g_object_set(alarm, "started-at", NULL, NULL);
+    journal_alarm(context, alarm, JOURNAL_STOP);
+  }
+
+  schedule_alarm(context, alarm);
+}
+
+/* Stops alarms set to stop on suspend and writes out pending settings, as
+ * nothing may run after suspend delay lock is released. Scheduler stays paused
+ * until resume_alarms(). */
+void
+suspend_alarms(AlarmContext *context)
+{
+  Alarm *alarm;
+
+  g_return_if_fail(context != NULL);
+
+  for (guint i = 0; i < context->alarms->len; i++)
+  {
+    alarm = g_ptr_array_index(context->alarms, i);
+    if (alarm->started_at && alarm->autostop_on_suspend)
+      stop_alarm(context, alarm);
+  }
+
+  save_dirty_alarms(context);
+  if (context->settings)
+    xfconf_batch_flush(context->settings);
+  scheduler_pause(context->scheduler);
+}
+
+/* All deadlines are rescheduled while scheduler is still paused, so alarms
+ * missed during suspend fire together in one dispatch. */
+void
+resume_alarms(AlarmContext *context)
+{
+  Alarm *alarm;
+
+  g_return_if_fail(context != NULL);
+
+  for (guint i = 0; i < context->alarms->len; i++)
+  {
+    alarm = g_ptr_array_index(context->alarms, i);
+    if (alarm->started_at)
+      resume_alarm(context, alarm);
+    else if (alarm->autostart_on_resume)
+      start_alarm(context, alarm);
+  }
+  scheduler_resume(context->scheduler);
+}
+
+// Power monitor callback of the context owner
+void
+alarm_context_power_changed(gboolean suspending, AlarmContext *context)
+{
+  if (suspending)
+    suspend_alarms(context);
+  else
+    resume_alarms(context);
+}
+
+// Stops alert of alarm, whether still coalescing or already firing
+void
+acknowledge_alarm(AlarmContext *context, Alarm *alarm)
+{
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM(alarm));
+
+  alert_coalescer_remove(context->coalescer, alarm);
+  if (!alert_executor_is_firing(context->executor, alarm))
+    return;
+
+  alert_executor_stop(context->executor, alarm);
+  journal_alarm(context, alarm, JOURNAL_ACK);
+}
+
+// Stops all alerts; returns FALSE if there was nothing to acknowledge
+gboolean
+acknowledge_all_alarms(AlarmContext *context)
+{
+  Alarm *alarm;
+  gboolean acknowledged = FALSE;
+
+  g_return_val_if_fail(context != NULL, FALSE);
+
+  for (guint i = 0; i < context->alarms->len; i++)
+  {
+    alarm = g_ptr_array_index(context->alarms, i);
+    if (alert_executor_is_firing(context->executor, alarm))
+      acknowledged = TRUE;
+    acknowledge_alarm(context, alarm);
+  }
+
+  return acknowledged;
+}
+
+/* Restores running state of alarms from journal. Alarms running according to
+ * settings of older plugin version are added to journal. */
+void
+replay_alarm_journal(AlarmContext *context)
+{
+  GDateTime *started_at;
+  Alarm *alarm;
+
+  g_return_if_fail(context != NULL);
+  g_return_if_fail(context->journal != NULL);
+
+  for (guint i = 0; i < context->alarms->len; i++)
+  {
+    alarm = g_ptr_array_index(context->alarms, i);
+    started_at = journal_get_started_at(context->journal, alarm->id);
+    if (started_at)
     {
-      pspec = alarm_class_props[prop_id];
-      xfconf_prop = g_strconcat("/", pspec->name, NULL);
-      // xfconf_g_property_bind_gdkrgba
-      xfconf_g_property_bind(channel, xfconf_prop, pspec->value_type, alarm, pspec->name);
-      g_free(xfconf_prop);
+      g_object_set(alarm, "started-at", started_at, NULL);
+      g_date_time_unref(started_at);
     }
+    else if (alarm->started_at)
+      journal_alarm(context, alarm, JOURNAL_START);
+  }
+}
 
-  return alarm;
+
+// External interface
+Alarm*
+alarm_new(void)
+{
+  return g_object_new(ALARM_PLUGIN_TYPE_ALARM, NULL);
 }
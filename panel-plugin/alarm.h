@@ -34,32 +34,8 @@ typedef enum
   ALARM_TYPE_COUNT
 } AlarmType;
 
-const gchar *alarm_type_icons[ALARM_TYPE_COUNT];
-const guint TIME_LIMITS[2*ALARM_TYPE_COUNT];
-
-enum RerunEvery
-{
-  NO_RERUN        = 0,
-  RERUN_DOW       = 0,
-  RERUN_MONDAY    = 1,
-  RERUN_TUEASDAY  = 1 << 1,
-  RERUN_WEDNESDAY = 1 << 2,
-  RERUN_THURSDAY  = 1 << 3,
-  RERUN_FRIDAY    = 1 << 4,
-  RERUN_SATURDAY  = 1 << 5,
-  RERUN_SUNDAY    = 1 << 6,
-  RERUN_WEEKDAY   = 31,
-  RERUN_WEEKEND   = 96,
-  RERUN_EVERYDAY  = 127
-};
-
-typedef enum
-{
-  RERUN_NDAYS = 0,
-  RERUN_NWEEKS,
-  RERUN_NMONTHS,
-  RERUN_MODE_COUNT
-} RerunMode;
+extern const gchar *alarm_type_icons[ALARM_TYPE_COUNT];
+extern const guint TIME_LIMITS[2*ALARM_TYPE_COUNT];
 
 typedef struct _Alarm Alarm;
 struct _Alarm
@@ -87,19 +63,42 @@ struct _Alarm
   GDateTime *started_at;
 
   // Runtime settings
+  guint order; // Persisted sparse ordering key
+  guint position; // Index in AlarmContext.alarms
+  GDateTime *deadline; // Next expiry of running alarm, notified as "deadline"
+  GDateTime *period_start; // Previous expiry of running alarm (or its start)
 };
 
 
 #define ALARM_PLUGIN_TYPE_ALARM (alarm_get_type())
 G_DECLARE_FINAL_TYPE(Alarm, alarm, ALARM_PLUGIN, ALARM, GObject)
 
-Alarm* alarm_new(XfconfChannel *channel);
-
-GList* load_alarm_settings(AlarmPlugin *plugin);
-void save_alarm_settings(AlarmPlugin *plugin, Alarm *alarm);
-void save_alarm_positions(AlarmPlugin *plugin,
-                          GList *alarm_iter_from, GList *alarm_iter_to);
-void reset_alarm_settings(AlarmPlugin *plugin, Alarm *alarm);
+Alarm* alarm_new(void);
+
+GPtrArray* load_alarm_settings(AlarmContext *context);
+void save_alarm_settings(AlarmContext *context, Alarm *alarm);
+void save_dirty_alarms(AlarmContext *context);
+void reset_alarm_settings(AlarmContext *context, Alarm *alarm);
+
+void alarm_list_append(AlarmContext *context, Alarm *alarm);
+void alarm_list_remove(AlarmContext *context, Alarm *alarm);
+void alarm_list_move(AlarmContext *context, Alarm *alarm, guint position);
+Alarm* alarm_list_get(AlarmContext *context, guint position);
+Alarm* lookup_alarm(AlarmContext *context, guint alarm_id);
+void bind_alarm_settings(AlarmContext *context, Alarm *alarm);
+void bind_alert_settings(AlarmContext *context);
+
+void schedule_alarm(AlarmContext *context, Alarm *alarm);
+void start_alarm(AlarmContext *context, Alarm *alarm);
+void stop_alarm(AlarmContext *context, Alarm *alarm);
+void resume_alarm(AlarmContext *context, Alarm *alarm);
+void suspend_alarms(AlarmContext *context);
+void resume_alarms(AlarmContext *context);
+void alarm_context_power_changed(gboolean suspending, AlarmContext *context);
+void acknowledge_alarm(AlarmContext *context, Alarm *alarm);
+gboolean acknowledge_all_alarms(AlarmContext *context);
+void replay_alarm_journal(AlarmContext *context);
+gdouble alarm_progress(Alarm *alarm, GDateTime *now);
 
 G_END_DECLS
 
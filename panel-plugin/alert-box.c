@@ -20,15 +20,19 @@
 #include <config.h>
 #endif
 
-#include <canberra.h>
 #include <libxfce4panel/xfce-panel-plugin.h>
 #include <xfconf/xfconf.h>
 #include <exo/exo.h>
 
-#include "common.h"
+#include "common-ui.h"
 #include "alert.h"
+#include "app-cache.h"
+#include "sound-player.h"
+#include "alarm-context.h"
+#include "alarm-plugin.h"
 #include "alert-box.h"
 #include "alert-box_ui.h"
+#include "tracing.h"
 
 typedef struct
 {
@@ -51,27 +55,33 @@ enum ProgramColumns
 enum ProgramEntries
 {
   PROGRAM_NONE = 0,
-  PROGRAM_CHOOSE_FILE = 2
+  PROGRAM_CHOOSE_FILE = 2,
+  PROGRAM_FIRST_APP = 4 // Shifted down by programs chosen from file
 };
 
 
 // Utilities
-static gboolean playback_finished(gpointer button);
-static void ca_playback_finished(ca_context *c, uint32_t id, int error_code, void *button);
 
 static void
-ca_playback_finished(ca_context *c, uint32_t id, int error_code, void *button)
+program_icon_queried(GObject *source_object, GAsyncResult *result, gpointer data)
 {
-  if (error_code != CA_ERROR_CANCELED)
-    g_idle_add(playback_finished, button);
-}
+  GtkTreeRowReference *row = data;
+  GtkTreeModel *model;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  GFileInfo *fileinfo;
 
-static gint
-app_order_func(gconstpointer left, gconstpointer right)
-{
-  // TODO: make sorting case insensitive
-  return g_utf8_collate(g_app_info_get_display_name(G_APP_INFO(left)),
-                        g_app_info_get_display_name(G_APP_INFO(right)));
+  fileinfo = g_file_query_info_finish(G_FILE(source_object), result, NULL);
+  path = gtk_tree_row_reference_get_path(row);
+  model = gtk_tree_row_reference_get_model(row);
+
+  if (fileinfo && path && gtk_tree_model_get_iter(model, &iter, path))
+    gtk_list_store_set(GTK_LIST_STORE(model), &iter,
+                       PR_COL_ICON, g_file_info_get_icon(fileinfo), -1);
+
+  gtk_tree_path_free(path);
+  g_clear_object(&fileinfo);
+  gtk_tree_row_reference_free(row);
 }
 
 static gchar*
@@ -92,75 +102,97 @@ show_program_dialog(GtkBuilder *builder, GtkWidget *parent)
   return filename;
 }
 
-static int
+// Row of app from AppList, below programs inserted by select_program_by_cmdline()
+static gint
+program_app_row(GtkTreeModel *model, gint app_index)
+{
+  GHashTable *chosen_programs = g_object_get_data(G_OBJECT(model), "chosen-programs");
+
+  return PROGRAM_FIRST_APP + g_hash_table_size(chosen_programs) + app_index;
+}
+
+static gint
 select_program_by_cmdline(GtkTreeModel *model, const gchar *filename)
 {
   gint active = PROGRAM_NONE;
+  AppList *apps;
+  GHashTable *chosen_programs;
+  GtkTreePath *path;
+  GtkTreeIter iter;
   GAppInfo *appinfo, *tree_appinfo;
   GError *error = NULL;
-  GtkTreeIter iter;
-  GtkTreePath *path;
+  gchar *cmdline;
   GFile *file;
-  GFileInfo *fileinfo;
-  GIcon *fileicon = NULL;
 
   if (exo_str_is_empty(filename))
     return PROGRAM_NONE;
 
-  appinfo = g_app_info_create_from_commandline(filename, NULL, G_APP_INFO_CREATE_NONE,
-                                               &error);
-  if (error)
-  {
-    g_warning("Failed to get app info: %s.", error->message);
-    g_error_free(error);
-    return PROGRAM_NONE;
-  }
+  apps = g_object_get_data(G_OBJECT(model), "app-list");
+  chosen_programs = g_object_get_data(G_OBJECT(model), "chosen-programs");
+  g_return_val_if_fail(apps != NULL && chosen_programs != NULL, PROGRAM_NONE);
 
   // Look for existing entry with given commandline and select if already added
-  if (gtk_tree_model_get_iter_first(model, &iter))
-    do
+  cmdline = app_list_normalize_cmdline(filename);
+  if (cmdline == NULL)
+    return PROGRAM_NONE;
+
+  // Few programs chosen from file are listed first, right below 'Choose program file'
+  appinfo = g_hash_table_lookup(chosen_programs, cmdline);
+  if (appinfo)
+  {
+    for (active = PROGRAM_CHOOSE_FILE + 1;
+         gtk_tree_model_iter_nth_child(model, &iter, NULL, active); active++)
     {
       gtk_tree_model_get(model, &iter, PR_COL_DATA, &tree_appinfo, -1);
-      if (tree_appinfo != NULL &&
-          !g_strcmp0(g_app_info_get_commandline(appinfo),
-                     g_app_info_get_commandline(tree_appinfo)))
-      {
-        path = gtk_tree_model_get_path(model, &iter);
-        active = gtk_tree_path_get_indices(path)[0];
-        gtk_tree_path_free(path);
-
-        g_clear_object(&appinfo);
+      if (tree_appinfo == appinfo)
         break;
-      }
     }
-    while (gtk_tree_model_iter_next(model, &iter));
+    g_warn_if_fail(tree_appinfo == appinfo);
+  }
+  else if ((active = app_list_find_cmdline(apps, cmdline)) != APP_LIST_NOT_FOUND)
+    active = program_app_row(model, active);
+  else
+    active = PROGRAM_NONE;
 
-  // Otherwise insert new entry right below 'Choose program file'
-  if (active == PROGRAM_NONE)
+  if (active != PROGRAM_NONE)
   {
-    active = PROGRAM_CHOOSE_FILE + 1;
+    g_free(cmdline);
+    return active;
+  }
 
-    file = g_file_new_for_path(filename);
-    fileinfo = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_ICON,
-        G_FILE_QUERY_INFO_NONE, NULL, NULL);
-    if (fileinfo != NULL)
-      fileicon = g_file_info_get_icon(fileinfo);
+  // Otherwise insert new entry right below 'Choose program file'
+  appinfo = g_app_info_create_from_commandline(filename, NULL, G_APP_INFO_CREATE_NONE,
+                                               &error);
+  if (error)
+  {
+    g_warning("Failed to get app info: %s.", error->message);
+    g_error_free(error);
+    g_free(cmdline);
+    return PROGRAM_NONE;
+  }
 
-    gtk_list_store_insert_with_values(GTK_LIST_STORE(model), NULL, active,
+  active = PROGRAM_CHOOSE_FILE + 1;
+  gtk_list_store_insert_with_values(GTK_LIST_STORE(model), NULL, active,
                                     PR_COL_DATA, appinfo,
-                                    PR_COL_ICON, fileicon,
+                                    PR_COL_ICON, NULL,
                                     PR_COL_NAME, g_app_info_get_display_name(appinfo),
                                     PR_COL_SEPARATOR, FALSE,
                                     PR_COL_HAS_ICON, TRUE, -1);
-
-    g_object_unref(fileinfo);
-    g_object_unref(file);
-  }
+  // App info is owned by store
+  g_hash_table_insert(chosen_programs, cmdline, appinfo);
+  path = gtk_tree_path_new_from_indices(active, -1);
+
+  // Icon is set once queried; row reference keeps model alive until then
+  file = g_file_new_for_path(filename);
+  g_file_query_info_async(file, G_FILE_ATTRIBUTE_STANDARD_ICON, G_FILE_QUERY_INFO_NONE,
+                          G_PRIORITY_DEFAULT, NULL, program_icon_queried,
+                          gtk_tree_row_reference_new(model, path));
+  g_object_unref(file);
+  gtk_tree_path_free(path);
 
   return active;
 }
 
-
 // Callbacks
 static void
 sound_chooser_selection_changed(GtkFileChooserButton *button, Alert *alert)
@@ -168,6 +200,7 @@ sound_chooser_selection_changed(GtkFileChooserButton *button, Alert *alert)
   gchar *filename;
   GObject = object;
   GtkBuilder *builder;
+  SoundPlayer *player;
 
   g_return_if_fail(GTK_IS_FILE_CHOOSER_BUTTON(button));
   g_return_if_fail(ALARM_PLUGIN_IS_ALERT(alert));
@@ -178,6 +211,10 @@ sound_chooser_selection_changed(GtkFileChooserButton *button, Alert *alert)
     gtk_file_chooser_unselect_all(GTK_FILE_CHOOSER(button));
   g_free(filename);
 
+  player = g_object_get_data(G_OBJECT(button), "sound-player");
+  if (player && alert->sound)
+    sound_player_cache(player, alert->sound);
+
   object = G_OBJECT(gtk_widget_get_ancestor(GTK_WIDGET(button), GTK_TYPE_FRAME));
   builder = g_object_get_data(object, "builder");
   g_return_if_fail(GTK_IS_BUILDER(builder));
@@ -198,13 +235,24 @@ clear_sound_clicked(GtkButton *button, Alert *alert)
   gtk_file_chooser_unselect_all(GTK_FILE_CHOOSER(object));
 }
 
+static void
+preview_finished(guint playback_id, gpointer button)
+{
+  if (GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(button), "playback-id")) == playback_id)
+  {
+    g_object_set_data(G_OBJECT(button), "playback-id", NULL);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), FALSE);
+  }
+  g_object_unref(button);
+}
+
 static void
 play_sound_toggled(GtkToggleButton *button, Alert *alert)
 {
   gboolean play;
   GObject *image;
-  ca_proplist *proplist;
-  int is_playing;
+  SoundPlayer *player;
+  guint playback_id;
 
   g_return_if_fail(GTK_IS_TOGGLE_BUTTON(button));
   g_return_if_fail(ALARM_PLUGIN_IS_ALERT(alert));
@@ -219,30 +267,38 @@ play_sound_toggled(GtkToggleButton *button, Alert *alert)
   gtk_button_set_image(GTK_BUTTON(button), GTK_WIDGET(image));
   gtk_toggle_button_set_active(button, play);
 
-  if (play)
+  // Preview shares plugin sound player and its cached samples with alerts
+  player = g_object_get_data(G_OBJECT(button), "sound-player");
+  g_return_if_fail(player != NULL);
+  playback_id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(button), "playback-id"));
+
+  if (play && playback_id == SOUND_PLAYER_NO_PLAYBACK)
   {
-    g_warn_if_fail(!ca_proplist_create(&proplist));
-    g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_MEDIA_FILENAME, alert->sound));
-    g_warn_if_fail(!ca_context_play_full(alert->context, 1, proplist, ca_playback_finished,
-                                         button));
-    g_warn_if_fail(!ca_proplist_destroy(proplist));
+    playback_id = sound_player_play(player, alert->sound, 1, preview_finished,
+                                    g_object_ref(button));
+    if (playback_id == SOUND_PLAYER_NO_PLAYBACK)
+    {
+      g_object_unref(button);
+      gtk_toggle_button_set_active(button, FALSE);
+      return;
+    }
+    g_object_set_data(G_OBJECT(button), "playback-id", GUINT_TO_POINTER(playback_id));
   }
-  else
+  else if (!play && playback_id != SOUND_PLAYER_NO_PLAYBACK)
   {
-    g_warn_if_fail(!ca_context_playing(alert->context, 1, &is_playing));
-    if (is_playing)
-      g_warn_if_fail(!ca_context_cancel(alert->context, 1));
+    g_object_set_data(G_OBJECT(button), "playback-id", NULL);
+    sound_player_stop(player, playback_id);
   }
 }
 
-static gboolean
-playback_finished(gpointer button)
+static void
+play_sound_destroy(GtkWidget *button, SoundPlayer *player)
 {
-  g_return_val_if_fail(GTK_IS_TOGGLE_BUTTON(button), G_SOURCE_REMOVE);
-
-  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), FALSE);
+  guint playback_id;
 
-  return G_SOURCE_REMOVE;
+  playback_id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(button), "playback-id"));
+  if (playback_id != SOUND_PLAYER_NO_PLAYBACK)
+    sound_player_stop(player, playback_id);
 }
 
 static gboolean
@@ -335,6 +391,67 @@ program_delete_event(GtkWidget *widget, GdkEvent *event)
   return FALSE;
 }
 
+/* Fill program list. Positions prefilled from .glade:
+ * PROGRAM_NONE:        (None)
+ * 1:                   separator
+ * PROGRAM_CHOOSE_FILE: file chooser
+ * 3:                   separator */
+static void
+apps_loaded(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+  GtkComboBox *program;
+  GtkTreeModel *store;
+  AppList *apps;
+  GAppInfo *app;
+  Alert *alert;
+  gint active_program;
+  GError *error = NULL;
+
+  // Alert box is already destroyed if loading has been cancelled
+  apps = app_cache_get_apps_finish(result, &error);
+  if (apps == NULL)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning("Failed to get applications: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  program = GTK_COMBO_BOX(data);
+  alert = g_object_get_data(G_OBJECT(program), "alert");
+  g_return_if_fail(ALARM_PLUGIN_IS_ALERT(alert));
+  store = gtk_combo_box_get_model(program);
+  g_return_if_fail(GTK_IS_LIST_STORE(store));
+
+  // Indexes of list are used to find rows of apps by id and command line
+  g_object_set_data_full(G_OBJECT(store), "app-list", apps,
+                         (GDestroyNotify) app_list_unref);
+  g_object_set_data_full(G_OBJECT(store), "chosen-programs",
+                         g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+                         (GDestroyNotify) g_hash_table_destroy);
+
+  for (guint i = 0; i < apps->apps->len; i++)
+  {
+    app = g_ptr_array_index(apps->apps, i);
+    // Reference is released in program_delete_event
+    gtk_list_store_insert_with_values(GTK_LIST_STORE(store), NULL, -1,
+                                      PR_COL_DATA, g_object_ref(app),
+                                      PR_COL_ICON, g_app_info_get_icon(app),
+                                      PR_COL_NAME, g_app_info_get_display_name(app),
+                                      PR_COL_SEPARATOR, FALSE,
+                                      PR_COL_HAS_ICON, TRUE, -1);
+  }
+
+  active_program = app_list_find_id(apps, alert->program);
+  if (active_program != APP_LIST_NOT_FOUND)
+    active_program = program_app_row(store, active_program);
+  else
+    // Program not found by ID, retry searching by command line
+    active_program = select_program_by_cmdline(store, alert->program);
+  gtk_combo_box_set_active(program, active_program);
+  gtk_widget_set_sensitive(GTK_WIDGET(program), TRUE);
+}
+
 static gboolean
 repeats_to_interval_sensitivity(GBinding *binding, const GValue *from_value,
                                 GValue *to_value, gpointer user_data)
@@ -350,10 +467,9 @@ show_alert_box(Alert *alert, XfcePanelPlugin *panel_plugin, GtkContainer *contai
 {
   GObject *object, *target, *program;
   GtkWidget *alert_box;
-  ca_context *sound_context;
-  GList *apps, *app_iter;
-  GAppInfo *app;
-  guint active_program = PROGRAM_NONE;
+  SoundPlayer *player = XFCE_ALARM_PLUGIN(panel_plugin)->context->sounds;
+  GCancellable *cancellable;
+  gint64 trace_start;
   PropertyBinding alert_bindings[] =
   {
     {"notification", "active", "notification", NULL, NULL},
@@ -365,6 +481,8 @@ show_alert_box(Alert *alert, XfcePanelPlugin *panel_plugin, GtkContainer *contai
     {"repeat-interval", "sensitive", "repeats", repeats_to_interval_sensitivity, NULL},
   };
 
+  TRACE_BEGIN(trace_start);
+
   // FIXME: save builder as gobject data of alert_box and send alert-box as
   // user_data to handlers using builder (as in other dialogs)
   // remove alert->builder afterwards
@@ -383,12 +501,19 @@ show_alert_box(Alert *alert, XfcePanelPlugin *panel_plugin, GtkContainer *contai
   gtk_container_add(container, alert_box);
   g_object_unref(alert_box);
 
-  // Create libcanberra context for playing sounds
-  if (!ca_context_create(&sound_context))
-    g_object_weak_ref(G_OBJECT(alert_box), (GWeakNotify) G_CALLBACK(ca_context_destroy),
-                      sound_context);
+  // Sounds are played by plugin wide player, sound preview is unavailable without it
+  object = gtk_builder_get_object(alert->builder, "play-sound");
+  g_return_val_if_fail(GTK_IS_TOGGLE_BUTTON(object), FALSE);
+  if (player)
+  {
+    g_object_set_data(object, "sound-player", player);
+    g_signal_connect(object, "destroy", G_CALLBACK(play_sound_destroy), player);
+    object = gtk_builder_get_object(alert->builder, "sound-chooser");
+    g_return_val_if_fail(GTK_IS_FILE_CHOOSER(object), FALSE);
+    g_object_set_data(object, "sound-player", player);
+  }
   else
-    g_warn_if_reached();
+    gtk_widget_set_sensitive(GTK_WIDGET(object), FALSE);
 
   // Seems to be no other way to add this parameter to widget through Glade
   object = gtk_builder_get_object(alert->builder, "program-runtime");
@@ -415,38 +540,17 @@ show_alert_box(Alert *alert, XfcePanelPlugin *panel_plugin, GtkContainer *contai
   gtk_combo_box_set_row_separator_func(GTK_COMBO_BOX(program), program_separator_func, NULL,
                                        NULL);
 
-  /* Fill program list. Positions prefilled from .glade:
-   * PROGRAM_NONE:        (None)
-   * 1:                   separator
-   * PROGRAM_CHOOSE_FILE: file chooser
-   * 3:                   separator */
-  object = gtk_builder_get_object(alert->builder, "program-store");
-  g_return_val_if_fail(GTK_IS_LIST_STORE(object), FALSE);
-  apps = g_app_info_get_all();
-  apps = g_list_sort(apps, app_order_func);
-  app_iter = apps;
-  while (app_iter)
-  {
-    app = app_iter->data;
-    if (g_app_info_should_show(app))
-    {
-      gtk_list_store_insert_with_values(GTK_LIST_STORE(object), NULL, -1,
-                                        PR_COL_DATA, app,
-                                        PR_COL_ICON, g_app_info_get_icon(app),
-                                        PR_COL_NAME, g_app_info_get_display_name(app),
-                                        PR_COL_SEPARATOR, FALSE,
-                                        PR_COL_HAS_ICON, TRUE, -1);
-      if ((alert->program != NULL) && !g_strcmp0(alert->program, g_app_info_get_id(app)))
-        active_program = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(object), NULL) - 1;
-    }
-    app_iter = app_iter->next;
-  }
-  g_list_free(apps);
-
-  if (!exo_str_is_empty(alert->program) && (active_program == PROGRAM_NONE))
-    // Program not found by ID, retry searching by command line
-    active_program = select_program_by_cmdline(GTK_TREE_MODEL(object), alert->program);
-  gtk_combo_box_set_active(GTK_COMBO_BOX(program), active_program);
+  /* Application list is shared by all alert boxes and loaded off the main
+   * thread. Program chooser stays insensitive until the list arrives. */
+  gtk_widget_set_sensitive(GTK_WIDGET(program), FALSE);
+  g_object_set_data(program, "alert", alert);
+  cancellable = g_cancellable_new();
+  g_signal_connect_swapped(alert_box, "destroy", G_CALLBACK(g_cancellable_cancel),
+                           cancellable);
+  g_object_weak_ref(G_OBJECT(alert_box), (GWeakNotify) G_CALLBACK(g_object_unref),
+                    cancellable);
+  app_cache_get_apps_async(XFCE_ALARM_PLUGIN(panel_plugin)->apps, cancellable,
+                           apps_loaded, program);
 
   // Set widgets according to alert properties
   object = gtk_builder_get_object(alert->builder, "sound-chooser");
@@ -465,6 +569,9 @@ show_alert_box(Alert *alert, XfcePanelPlugin *panel_plugin, GtkContainer *contai
                                 alert_bindings[i].transform_from,
                                 NULL, NULL);
   }
+  // Sound chooser resolving its folder is the costly part of the section
+  TRACE_END(trace_start, "show alert box", "sound %s",
+            alert->sound != NULL ? alert->sound : "none");
 
   return TRUE;
 }
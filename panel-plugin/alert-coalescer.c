@@ -0,0 +1,280 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <glib/gi18n-lib.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "sound-player.h"
+#include "notification.h"
+#include "alert-executor.h"
+#include "alert-coalescer.h"
+
+/* Collects alerts of alarms expiring within window (in seconds) from the
+ * first one and fires them together. Alarms with identical alert payload
+ * share single firing, so burst of alarms with the same sound or program
+ * plays/launches it once, with single notification listing names of all
+ * alarms in the group. Groups with different payloads notify separately, as
+ * each is repeated and acknowledged on its own. Window of 0 (the default)
+ * only coalesces alarms expiring in the same scheduler dispatch. */
+struct _AlertCoalescer
+{
+  Scheduler *scheduler; // Key: AlertCoalescer* for window timer
+  AlertExecutor *executor;
+  guint window;
+
+  GPtrArray *expired; // Expired*, in order of expiry
+  GHashTable *entries; // key => Expired* in expired, for O(1) replacement
+  guint flush_id; // Idle source flushing for zero window
+
+  guint64 fired;
+  gint64 total_latency; // From due time of alarms to their alerts being fired
+};
+
+typedef struct
+{
+  gpointer key; // NULL - removed while waiting for window to close
+  gint64 due; // Scheduler time
+  gchar *name;
+  Alert *alert;
+} Expired;
+
+typedef struct
+{
+  Alert *alert;
+  GPtrArray *keys;
+  GString *names;
+} AlertGroup;
+
+
+// Utilities
+static void
+expired_free(Expired *expired)
+{
+  g_free(expired->name);
+  g_object_unref(expired->alert);
+  g_slice_free(Expired, expired);
+}
+
+static gboolean
+alert_payload_equal(Alert *left, Alert *right)
+{
+  return left == right ||
+    (left->notification == right->notification &&
+     !g_strcmp0(left->sound, right->sound) &&
+     left->sound_loops == right->sound_loops &&
+     !g_strcmp0(left->program, right->program) &&
+     !g_strcmp0(left->program_options, right->program_options) &&
+     left->program_runtime == right->program_runtime &&
+     left->repeats == right->repeats &&
+     left->interval == right->interval);
+}
+
+static void
+coalescer_flush(AlertCoalescer *coalescer)
+{
+  GPtrArray *expired, *groups;
+  AlertGroup *group = NULL;
+  Expired *entry;
+  gint64 now = scheduler_get_time(coalescer->scheduler);
+
+  // Alarms expiring from executor callbacks start new batch
+  expired = g_steal_pointer(&coalescer->expired);
+  coalescer->expired = g_ptr_array_new_with_free_func((GDestroyNotify) expired_free);
+  g_hash_table_remove_all(coalescer->entries);
+
+  groups = g_ptr_array_new();
+  for (guint i = 0; i < expired->len; i++)
+  {
+    entry = g_ptr_array_index(expired, i);
+    if (entry->key == NULL)
+      continue;
+
+    coalescer->fired++;
+    coalescer->total_latency += MAX(now - entry->due, 0);
+
+    for (guint j = 0; j < groups->len; j++)
+    {
+      group = g_ptr_array_index(groups, j);
+      if (alert_payload_equal(group->alert, entry->alert))
+        break;
+      group = NULL;
+    }
+
+    if (group == NULL)
+    {
+      group = g_slice_new(AlertGroup);
+      group->alert = entry->alert;
+      group->keys = g_ptr_array_new();
+      group->names = g_string_new(NULL);
+      g_ptr_array_add(groups, group);
+    }
+    g_ptr_array_add(group->keys, entry->key);
+
+    if (group->names->len)
+      g_string_append_c(group->names, '\n');
+    g_string_append(group->names, entry->name && *entry->name ? entry->name : _("Unnamed alarm"));
+  }
+
+  for (guint i = 0; i < groups->len; i++)
+  {
+    group = g_ptr_array_index(groups, i);
+    alert_executor_fire(coalescer->executor, group->keys->pdata, group->keys->len,
+                        group->alert,
+                        group->alert->notification ? group->names->str : NULL);
+
+    g_string_free(group->names, TRUE);
+    g_ptr_array_free(group->keys, TRUE);
+    g_slice_free(AlertGroup, group);
+  }
+
+  g_ptr_array_free(groups, TRUE);
+  g_ptr_array_unref(expired);
+}
+
+// Callbacks
+static void
+window_closed(gpointer key, gpointer user_data)
+{
+  coalescer_flush(key);
+}
+
+static gboolean
+dispatch_finished(gpointer data)
+{
+  AlertCoalescer *coalescer = data;
+
+  coalescer->flush_id = 0;
+  coalescer_flush(coalescer);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+// External interface
+AlertCoalescer*
+alert_coalescer_new(Scheduler *scheduler, AlertExecutor *executor, guint window)
+{
+  AlertCoalescer *coalescer;
+
+  g_return_val_if_fail(scheduler != NULL, NULL);
+  g_return_val_if_fail(executor != NULL, NULL);
+
+  coalescer = g_slice_new0(AlertCoalescer);
+  coalescer->scheduler = scheduler;
+  coalescer->executor = executor;
+  coalescer->window = window;
+  coalescer->expired = g_ptr_array_new_with_free_func((GDestroyNotify) expired_free);
+  coalescer->entries = g_hash_table_new(NULL, NULL);
+
+  return coalescer;
+}
+
+// Alerts still waiting for window to close are dropped
+void
+alert_coalescer_free(AlertCoalescer *coalescer)
+{
+  if (coalescer == NULL)
+    return;
+
+  scheduler_remove(coalescer->scheduler, coalescer);
+  if (coalescer->flush_id)
+    g_source_remove(coalescer->flush_id);
+  g_ptr_array_unref(coalescer->expired);
+  g_hash_table_destroy(coalescer->entries);
+
+  g_slice_free(AlertCoalescer, coalescer);
+}
+
+// Applies from the next batch on
+void
+alert_coalescer_set_window(AlertCoalescer *coalescer, guint window)
+{
+  g_return_if_fail(coalescer != NULL);
+
+  coalescer->window = window;
+}
+
+// Due is scheduler time at which key expired, for latency accounting
+void
+alert_coalescer_add(AlertCoalescer *coalescer, gpointer key, gint64 due, const gchar *name,
+                    Alert *alert)
+{
+  Expired *expired;
+
+  g_return_if_fail(coalescer != NULL);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALERT(alert));
+
+  // Alarm expiring again within window is alerted once
+  alert_coalescer_remove(coalescer, key);
+
+  expired = g_slice_new(Expired);
+  expired->key = key;
+  expired->due = due;
+  expired->name = g_strdup(name);
+  expired->alert = g_object_ref(alert);
+  g_ptr_array_add(coalescer->expired, expired);
+  g_hash_table_insert(coalescer->entries, key, expired);
+
+  if (coalescer->expired->len > 1)
+    return;
+
+  if (coalescer->window)
+    scheduler_add(coalescer->scheduler, coalescer,
+                  scheduler_get_time(coalescer->scheduler) + coalescer->window * G_USEC_PER_SEC,
+                  window_closed, NULL);
+  else if (coalescer->flush_id == 0)
+    coalescer->flush_id = g_idle_add(dispatch_finished, coalescer);
+}
+
+/* Drops alert of key (e.g. removed alarm) that is still waiting for window to
+ * close. Entry is only marked, so mass expiry stays linear; it is freed with
+ * the rest of the batch. */
+void
+alert_coalescer_remove(AlertCoalescer *coalescer, gpointer key)
+{
+  Expired *expired;
+
+  g_return_if_fail(coalescer != NULL);
+
+  expired = g_hash_table_lookup(coalescer->entries, key);
+  if (expired == NULL)
+    return;
+
+  g_hash_table_remove(coalescer->entries, key);
+  expired->key = NULL;
+}
+
+/* Number of alerts fired so far and their total latency, including time spent
+ * waiting for window to close. Any of output arguments may be NULL. */
+void
+alert_coalescer_get_stats(AlertCoalescer *coalescer, guint64 *fired, gint64 *total_latency)
+{
+  g_return_if_fail(coalescer != NULL);
+
+  if (fired)
+    *fired = coalescer->fired;
+  if (total_latency)
+    *total_latency = coalescer->total_latency;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_ALERT_COALESCER_H__
+#define __ALARM_PLUGIN_ALERT_COALESCER_H__
+
+G_BEGIN_DECLS
+
+#define ALERT_COALESCER_DEFAULT_WINDOW 0
+
+typedef struct _AlertCoalescer AlertCoalescer;
+
+AlertCoalescer* alert_coalescer_new(Scheduler *scheduler, AlertExecutor *executor,
+                                    guint window);
+void alert_coalescer_free(AlertCoalescer *coalescer);
+
+void alert_coalescer_set_window(AlertCoalescer *coalescer, guint window);
+void alert_coalescer_add(AlertCoalescer *coalescer, gpointer key, gint64 due,
+                         const gchar *name, Alert *alert);
+void alert_coalescer_remove(AlertCoalescer *coalescer, gpointer key);
+void alert_coalescer_get_stats(AlertCoalescer *coalescer, guint64 *fired,
+                               gint64 *total_latency);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_ALERT_COALESCER_H__ */
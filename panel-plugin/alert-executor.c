@@ -0,0 +1,518 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <gio/gdesktopappinfo.h>
+#include <glib/gi18n-lib.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "sound-player.h"
+#include "notification.h"
+#include "alert-executor.h"
+#include "tracing.h"
+
+/* Runs alerts of expired alarms: plays sound, launches program and repeats
+ * both every interval until repeat count is reached or alert is stopped.
+ * Single firing may serve several keys (alarms coalesced into one alert),
+ * acknowledging any of them stops the whole firing. Dismissing notification
+ * of firing is reported to dismissed func, which is expected to acknowledge it.
+ * Programs are spawned from idle callback, one per main loop iteration, and
+ * no more than max_children run at once - remaining ones wait in queue. This
+ * way mass expiry of alarms neither blocks panel in fork/exec nor floods
+ * system with processes. Repeats and program runtime limits are timers of
+ * plugin scheduler, so they share its single timeout source. */
+struct _AlertExecutor
+{
+  Scheduler *scheduler; // Keys: Firing* for repeats, GSubprocess* for runtime limits
+  SoundPlayer *sounds; // NULL if sound is unavailable
+  Notifier *notifier;
+
+  GHashTable *firings; // key => Firing*, every key of firing holds reference
+  GQueue *pending; // Firing* waiting to launch program
+  guint launch_id; // Idle source launching pending programs
+  GHashTable *children; // GSubprocess* => Firing*, running programs
+  guint max_children;
+  GCancellable *cancellable; // Cancels waiting for children once executor is freed
+
+  AlertExecutorFunc dismissed;
+  gpointer dismissed_data;
+};
+
+typedef struct
+{
+  AlertExecutor *executor;
+  GPtrArray *keys;
+  Alert *alert;
+  gchar *names; // Notification body, NULL for no notification
+  guint notification; // Handle reused by repeats, so bubble is replaced
+  guint repeats_left; // REPEAT_UNTIL_ACK - until stopped
+  guint playback_id;
+  GSubprocess *child;
+  gboolean pending;
+  gboolean stopped;
+
+  // Held by executor->firings, pending queue, playback and child
+  gint ref_count;
+} Firing;
+
+
+// Utilities
+static Firing*
+firing_ref(Firing *firing)
+{
+  firing->ref_count++;
+  return firing;
+}
+
+static void
+firing_unref(Firing *firing)
+{
+  if (--firing->ref_count)
+    return;
+
+  g_ptr_array_unref(firing->keys);
+  g_object_unref(firing->alert);
+  g_free(firing->names);
+  g_slice_free(Firing, firing);
+}
+
+static void
+firing_remove(Firing *firing)
+{
+  AlertExecutor *executor = firing->executor;
+
+  notifier_release(executor->notifier, firing->notification);
+  firing->stopped = TRUE;
+  // Last key may release last reference
+  firing_ref(firing);
+  for (guint i = 0; i < firing->keys->len; i++)
+    g_hash_table_remove(executor->firings, g_ptr_array_index(firing->keys, i));
+  firing_unref(firing);
+}
+
+// Firing is over when nothing is playing, running or due anymore
+static void
+firing_finish_if_idle(Firing *firing)
+{
+  if (firing->stopped || firing->pending || firing->child != NULL ||
+      firing->playback_id != SOUND_PLAYER_NO_PLAYBACK ||
+      scheduler_contains(firing->executor->scheduler, firing))
+    return;
+
+  firing_remove(firing);
+}
+
+/* Program is either id of installed app or path of executable. Field codes
+ * of app command line are dropped, as there are no files or URIs to pass. */
+static gboolean
+alert_program_argv(Alert *alert, GPtrArray *argv, GError **error)
+{
+  GDesktopAppInfo *app;
+  const gchar *cmdline;
+  gchar **args;
+  gboolean parsed;
+
+  app = g_desktop_app_info_new(alert->program);
+  if (app)
+  {
+    cmdline = g_app_info_get_commandline(G_APP_INFO(app));
+    if (cmdline == NULL)
+    {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Application has no command line");
+      g_object_unref(app);
+      return FALSE;
+    }
+
+    parsed = g_shell_parse_argv(cmdline, NULL, &args, error);
+    g_object_unref(app);
+    if (!parsed)
+      return FALSE;
+
+    for (guint i = 0; args[i]; i++)
+      if (args[i][0] == '%' && args[i][1] != '\0' && args[i][2] == '\0')
+        g_free(args[i]);
+      else
+        g_ptr_array_add(argv, args[i]);
+    g_free(args);
+  }
+  else
+    g_ptr_array_add(argv, g_strdup(alert->program));
+
+  if (alert->program_options && *alert->program_options)
+  {
+    if (!g_shell_parse_argv(alert->program_options, NULL, &args, error))
+      return FALSE;
+
+    for (guint i = 0; args[i]; i++)
+      g_ptr_array_add(argv, args[i]);
+    g_free(args);
+  }
+
+  g_ptr_array_add(argv, NULL);
+  return TRUE;
+}
+
+static void child_exited(GObject *source_object, GAsyncResult *result, gpointer data);
+static void runtime_exceeded(gpointer key, gpointer user_data);
+
+static void
+firing_launch(Firing *firing)
+{
+  AlertExecutor *executor = firing->executor;
+  Alert *alert = firing->alert;
+  GPtrArray *argv;
+  GSubprocess *child = NULL;
+  GError *error = NULL;
+
+  argv = g_ptr_array_new_with_free_func(g_free);
+  if (alert_program_argv(alert, argv, &error))
+    child = g_subprocess_newv((const gchar * const *) argv->pdata, G_SUBPROCESS_FLAGS_NONE,
+                              &error);
+  g_ptr_array_free(argv, TRUE);
+
+  if (child == NULL)
+  {
+    g_message("Failed to run alert program '%s': %s", alert->program, error->message);
+    g_error_free(error);
+    return;
+  }
+
+  firing->child = child;
+  g_hash_table_insert(executor->children, child, firing);
+  g_subprocess_wait_async(child, executor->cancellable, child_exited, firing_ref(firing));
+
+  if (alert->program_runtime)
+    scheduler_add(executor->scheduler, child,
+                  scheduler_get_time(executor->scheduler) + alert->program_runtime * G_USEC_PER_SEC,
+                  runtime_exceeded, executor);
+}
+
+static gboolean launch_pending(gpointer data);
+
+static void
+executor_schedule_launch(AlertExecutor *executor)
+{
+  if (executor->launch_id || g_queue_is_empty(executor->pending) ||
+      g_hash_table_size(executor->children) >= executor->max_children)
+    return;
+
+  executor->launch_id = g_idle_add(launch_pending, executor);
+}
+
+static void sound_finished(guint playback_id, gpointer user_data);
+static void repeat_due(gpointer key, gpointer user_data);
+
+/* Single run of alert. Sound or program still active from previous run is
+ * left alone instead of being started again on top of it. */
+static void
+firing_run(Firing *firing)
+{
+  AlertExecutor *executor = firing->executor;
+  Alert *alert = firing->alert;
+
+  if (alert->notification && firing->names)
+    firing->notification = notifier_show(executor->notifier, firing->notification,
+                                         _("Alarm expired"), firing->names);
+
+  if (alert->sound && executor->sounds &&
+      firing->playback_id == SOUND_PLAYER_NO_PLAYBACK)
+  {
+    firing->playback_id = sound_player_play(executor->sounds, alert->sound,
+                                            alert->sound_loops, sound_finished, firing);
+    if (firing->playback_id != SOUND_PLAYER_NO_PLAYBACK)
+      firing_ref(firing);
+  }
+
+  if (alert->program && *alert->program && firing->child == NULL && !firing->pending)
+  {
+    firing->pending = TRUE;
+    g_queue_push_tail(executor->pending, firing_ref(firing));
+    executor_schedule_launch(executor);
+  }
+
+  if (alert->interval != NO_ALERT_REPEAT &&
+      (firing->repeats_left == REPEAT_UNTIL_ACK || --firing->repeats_left > 0))
+    scheduler_add(executor->scheduler, firing,
+                  scheduler_get_time(executor->scheduler) + alert->interval * G_USEC_PER_SEC,
+                  repeat_due, NULL);
+
+  firing_finish_if_idle(firing);
+}
+
+
+// Callbacks
+static gboolean
+launch_pending(gpointer data)
+{
+  AlertExecutor *executor = data;
+  Firing *firing;
+
+  // Single spawn per main loop iteration keeps panel responsive
+  firing = g_queue_pop_head(executor->pending);
+  if (firing)
+  {
+    firing->pending = FALSE;
+    firing_launch(firing);
+    firing_finish_if_idle(firing);
+    firing_unref(firing);
+  }
+
+  if (g_queue_is_empty(executor->pending) ||
+      g_hash_table_size(executor->children) >= executor->max_children)
+  {
+    executor->launch_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+child_exited(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+  GSubprocess *child = G_SUBPROCESS(source_object);
+  Firing *firing = data;
+  AlertExecutor *executor;
+  GError *error = NULL;
+
+  // Executor is already freed if waiting has been cancelled
+  if (!g_subprocess_wait_finish(child, result, &error))
+  {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free(error);
+      g_object_unref(child);
+      firing_unref(firing);
+      return;
+    }
+
+    g_warning("Failed to wait for alert program '%s': %s", firing->alert->program,
+              error->message);
+    g_error_free(error);
+  }
+
+  executor = firing->executor;
+  scheduler_remove(executor->scheduler, child);
+  g_hash_table_remove(executor->children, child);
+  g_object_unref(child);
+  firing->child = NULL;
+
+  firing_finish_if_idle(firing);
+  firing_unref(firing);
+
+  executor_schedule_launch(executor);
+}
+
+static void
+runtime_exceeded(gpointer key, gpointer user_data)
+{
+  g_subprocess_force_exit(G_SUBPROCESS(key));
+}
+
+static void
+sound_finished(guint playback_id, gpointer user_data)
+{
+  Firing *firing = user_data;
+
+  firing->playback_id = SOUND_PLAYER_NO_PLAYBACK;
+  firing_finish_if_idle(firing);
+  firing_unref(firing);
+}
+
+static void
+repeat_due(gpointer key, gpointer user_data)
+{
+  firing_run(key);
+}
+
+static void
+notification_dismissed(guint handle, gpointer user_data)
+{
+  AlertExecutor *executor = user_data;
+  GHashTableIter ht_iter;
+  gpointer key;
+  Firing *firing;
+
+  g_hash_table_iter_init(&ht_iter, executor->firings);
+  while (g_hash_table_iter_next(&ht_iter, &key, (gpointer) &firing))
+    if (firing->notification == handle)
+    {
+      if (executor->dismissed)
+        executor->dismissed(key, executor->dismissed_data);
+      else
+        alert_executor_stop(executor, key);
+      return;
+    }
+}
+
+
+// External interface
+AlertExecutor*
+alert_executor_new(Scheduler *scheduler, SoundPlayer *sounds, Notifier *notifier,
+                   guint max_children, AlertExecutorFunc dismissed, gpointer user_data)
+{
+  AlertExecutor *executor;
+
+  g_return_val_if_fail(scheduler != NULL, NULL);
+  g_return_val_if_fail(notifier != NULL, NULL);
+  g_return_val_if_fail(max_children > 0, NULL);
+
+  executor = g_slice_new0(AlertExecutor);
+  executor->scheduler = scheduler;
+  executor->sounds = sounds;
+  executor->notifier = notifier;
+  executor->firings = g_hash_table_new_full(NULL, NULL, NULL,
+                                            (GDestroyNotify) firing_unref);
+  executor->pending = g_queue_new();
+  executor->children = g_hash_table_new(NULL, NULL);
+  executor->max_children = max_children;
+  executor->cancellable = g_cancellable_new();
+  executor->dismissed = dismissed;
+  executor->dismissed_data = user_data;
+  notifier_set_dismissed_func(notifier, notification_dismissed, executor);
+
+  return executor;
+}
+
+/* Has to be called before scheduler, sound player and notifier are freed. Programs
+ * without runtime limit are left running, others are killed, as nothing
+ * would stop them otherwise. */
+void
+alert_executor_free(AlertExecutor *executor)
+{
+  GHashTableIter ht_iter;
+  GSubprocess *child;
+  Firing *firing;
+
+  if (executor == NULL)
+    return;
+
+  notifier_set_dismissed_func(executor->notifier, NULL, NULL);
+  g_cancellable_cancel(executor->cancellable);
+  g_object_unref(executor->cancellable);
+
+  if (executor->launch_id)
+    g_source_remove(executor->launch_id);
+
+  while ((firing = g_queue_pop_head(executor->pending)))
+  {
+    firing->pending = FALSE;
+    firing_unref(firing);
+  }
+  g_queue_free(executor->pending);
+
+  g_hash_table_iter_init(&ht_iter, executor->children);
+  while (g_hash_table_iter_next(&ht_iter, (gpointer) &child, NULL))
+    if (scheduler_remove(executor->scheduler, child))
+      g_subprocess_force_exit(child);
+  g_hash_table_destroy(executor->children);
+
+  // Sound and child callbacks still pending only release their references
+  g_hash_table_iter_init(&ht_iter, executor->firings);
+  while (g_hash_table_iter_next(&ht_iter, NULL, (gpointer) &firing))
+  {
+    firing->stopped = TRUE;
+    scheduler_remove(executor->scheduler, firing);
+  }
+  g_hash_table_destroy(executor->firings);
+
+  g_slice_free(AlertExecutor, executor);
+}
+
+/* Starts single alert for all keys (usually Alarm*). Alerts still firing for
+ * any of these keys are stopped first. Names are shown in notification if
+ * alert has one. */
+void
+alert_executor_fire(AlertExecutor *executor, gpointer *keys, guint n_keys, Alert *alert,
+                    const gchar *names)
+{
+  Firing *firing;
+  gint64 trace_start;
+
+  g_return_if_fail(executor != NULL);
+  g_return_if_fail(keys != NULL && n_keys > 0);
+  g_return_if_fail(ALARM_PLUGIN_IS_ALERT(alert));
+
+  TRACE_BEGIN(trace_start);
+
+  firing = g_slice_new0(Firing);
+  firing->executor = executor;
+  firing->keys = g_ptr_array_sized_new(n_keys);
+  firing->alert = g_object_ref(alert);
+  firing->names = g_strdup(names);
+  firing->repeats_left = alert->repeats;
+  firing->playback_id = SOUND_PLAYER_NO_PLAYBACK;
+
+  for (guint i = 0; i < n_keys; i++)
+  {
+    alert_executor_stop(executor, keys[i]);
+    g_ptr_array_add(firing->keys, keys[i]);
+    g_hash_table_insert(executor->firings, keys[i], firing_ref(firing));
+  }
+
+  firing_run(firing);
+  TRACE_END(trace_start, "alert dispatch", "%u alarms", n_keys);
+}
+
+// Acknowledges alert: cancels repeats, closes notification, stops sound and kills program
+void
+alert_executor_stop(AlertExecutor *executor, gpointer key)
+{
+  Firing *firing;
+
+  g_return_if_fail(executor != NULL);
+
+  firing = g_hash_table_lookup(executor->firings, key);
+  if (firing == NULL)
+    return;
+
+  firing->stopped = TRUE;
+  scheduler_remove(executor->scheduler, firing);
+
+  if (firing->pending)
+  {
+    g_queue_remove(executor->pending, firing);
+    firing->pending = FALSE;
+    firing_unref(firing);
+  }
+
+  notifier_close(executor->notifier, firing->notification);
+  firing->notification = NOTIFIER_NO_NOTIFICATION;
+
+  if (firing->playback_id != SOUND_PLAYER_NO_PLAYBACK)
+    sound_player_stop(executor->sounds, firing->playback_id);
+
+  if (firing->child)
+    g_subprocess_force_exit(firing->child);
+
+  firing_remove(firing);
+}
+
+gboolean
+alert_executor_is_firing(AlertExecutor *executor, gpointer key)
+{
+  g_return_val_if_fail(executor != NULL, FALSE);
+
+  return g_hash_table_contains(executor->firings, key);
+}
@@ -0,0 +1,40 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_ALERT_EXECUTOR_H__
+#define __ALARM_PLUGIN_ALERT_EXECUTOR_H__
+
+G_BEGIN_DECLS
+
+typedef void (*AlertExecutorFunc) (gpointer key, gpointer user_data);
+
+typedef struct _AlertExecutor AlertExecutor;
+
+AlertExecutor* alert_executor_new(Scheduler *scheduler, SoundPlayer *sounds,
+                                  Notifier *notifier, guint max_children,
+                                  AlertExecutorFunc dismissed, gpointer user_data);
+void alert_executor_free(AlertExecutor *executor);
+
+void alert_executor_fire(AlertExecutor *executor, gpointer *keys, guint n_keys, Alert *alert,
+                         const gchar *names);
+void alert_executor_stop(AlertExecutor *executor, gpointer key);
+gboolean alert_executor_is_firing(AlertExecutor *executor, gpointer key);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_ALERT_EXECUTOR_H__ */
@@ -20,8 +20,7 @@
 #include <config.h>
 #endif
 
-#include <libxfce4panel/xfce-panel-plugin.h>
-#include <xfconf/xfconf.h>
+#include <glib-object.h>
 
 #include "alert.h"
 
@@ -207,23 +206,7 @@ alert_init(Alert *alert)
 
 // External interface
 Alert*
-alert_new(XfconfChannel *channel)
+alert_new(void)
 {
-  Alert *alert = g_object_new(ALARM_PLUGIN_TYPE_ALERT, NULL);
-  gint prop_id;
-  gchar *xfconf_prop;
-  GParamSpec *pspec;
-
-  if (channel == NULL)
-    return alert;
-
-  for (prop_id = 1; prop_id < ALERT_PROP_COUNT; prop_id++)
-  {
-    pspec = alert_class_props[prop_id];
-    xfconf_prop = g_strconcat("/", pspec->name, NULL);
-    xfconf_g_property_bind(channel, xfconf_prop, pspec->value_type, alert, pspec->name);
-    g_free(xfconf_prop);
-  }
-
-  return alert;
+  return g_object_new(ALARM_PLUGIN_TYPE_ALERT, NULL);
 }
@@ -48,7 +48,7 @@ struct _Alert
 #define ALARM_PLUGIN_TYPE_ALERT (alert_get_type())
 G_DECLARE_FINAL_TYPE(Alert, alert, ALARM_PLUGIN, ALERT, GObject)
 
-Alert* alert_new(XfconfChannel *channel);
+Alert* alert_new(void);
 
 G_END_DECLS
 
@@ -0,0 +1,339 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <gio/gio.h>
+
+#include "app-cache.h"
+
+/* List of applications shown in alert program chooser. It is loaded in
+ * worker thread on first request, kept for plugin lifetime and shared by all
+ * alert boxes. Any change of installed applications drops the list, so it is
+ * reloaded on next request. Indexes by id and command line are built in the
+ * same pass, so looking up program of alert does not scan the list. */
+struct _AppCache
+{
+  AppList *apps; // NULL if not loaded
+  GQueue *waiting; // GTask* waiting for apps to load
+  GCancellable *loading; // NULL if not loading
+  guint generation; // Incremented on every change of installed applications
+
+  GAppInfoMonitor *monitor;
+  gulong monitor_id;
+};
+
+typedef struct
+{
+  GAppInfo *app;
+  gchar *sort_key;
+} AppEntry;
+
+
+// Utilities
+static gint
+app_entry_order_func(gconstpointer left, gconstpointer right)
+{
+  // GPtrArray passes pointers to elements
+  return strcmp((*(AppEntry**) left)->sort_key, (*(AppEntry**) right)->sort_key);
+}
+
+// Runs in worker thread
+static void
+load_apps(GTask *task, gpointer source_object, gpointer task_data,
+          GCancellable *cancellable)
+{
+  GList *app_list, *app_iter;
+  GPtrArray *entries;
+  AppList *list;
+  AppEntry *entry;
+  gchar *name, *cmdline;
+  const gchar *id;
+  gpointer index;
+
+  entries = g_ptr_array_new();
+  app_list = g_app_info_get_all();
+  for (app_iter = app_list; app_iter; app_iter = app_iter->next)
+  {
+    if (!g_app_info_should_show(app_iter->data))
+    {
+      g_object_unref(app_iter->data);
+      continue;
+    }
+
+    // Collation keys are computed once per app instead of once per comparison
+    entry = g_slice_new(AppEntry);
+    entry->app = app_iter->data;
+    name = g_utf8_casefold(g_app_info_get_display_name(entry->app), -1);
+    entry->sort_key = g_utf8_collate_key(name, -1);
+    g_free(name);
+    g_ptr_array_add(entries, entry);
+  }
+  g_list_free(app_list);
+
+  g_ptr_array_sort(entries, app_entry_order_func);
+
+  list = g_slice_new(AppList);
+  list->apps = g_ptr_array_new_full(entries->len, g_object_unref);
+  // Ids are owned by apps
+  list->ids = g_hash_table_new(g_str_hash, g_str_equal);
+  list->cmdlines = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  list->ref_count = 1;
+
+  for (guint i = 0; i < entries->len; i++)
+  {
+    entry = g_ptr_array_index(entries, i);
+    g_ptr_array_add(list->apps, entry->app);
+    g_free(entry->sort_key);
+    g_slice_free(AppEntry, entry);
+
+    // First app in display order wins for duplicate keys
+    index = GUINT_TO_POINTER(i + 1);
+    id = g_app_info_get_id(g_ptr_array_index(list->apps, i));
+    if (id && !g_hash_table_contains(list->ids, id))
+      g_hash_table_insert(list->ids, (gpointer) id, index);
+
+    cmdline = app_list_normalize_cmdline(
+        g_app_info_get_commandline(g_ptr_array_index(list->apps, i)));
+    if (cmdline && !g_hash_table_contains(list->cmdlines, cmdline))
+      g_hash_table_insert(list->cmdlines, cmdline, index);
+    else
+      g_free(cmdline);
+  }
+  g_ptr_array_free(entries, TRUE);
+
+  g_task_return_pointer(task, list, (GDestroyNotify) app_list_unref);
+}
+
+static void apps_loaded(GObject *source_object, GAsyncResult *result, gpointer data);
+
+static void
+app_cache_load(AppCache *cache)
+{
+  GTask *task;
+
+  cache->loading = g_cancellable_new();
+  task = g_task_new(NULL, cache->loading, apps_loaded, cache);
+  g_task_set_task_data(task, GUINT_TO_POINTER(cache->generation), NULL);
+  g_task_run_in_thread(task, load_apps);
+  g_object_unref(task);
+}
+
+
+// Callbacks
+static void
+apps_loaded(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+  AppCache *cache;
+  AppList *apps;
+  GTask *task;
+  GError *error = NULL;
+
+  // Cache is already freed if loading has been cancelled
+  apps = g_task_propagate_pointer(G_TASK(result), &error);
+  if (apps == NULL)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning("Failed to load applications: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  cache = data;
+  g_clear_object(&cache->loading);
+
+  // Applications changed while loading
+  if (GPOINTER_TO_UINT(g_task_get_task_data(G_TASK(result))) != cache->generation)
+  {
+    app_list_unref(apps);
+    app_cache_load(cache);
+    return;
+  }
+
+  cache->apps = apps;
+  while ((task = g_queue_pop_head(cache->waiting)))
+  {
+    g_task_return_pointer(task, app_list_ref(apps), (GDestroyNotify) app_list_unref);
+    g_object_unref(task);
+  }
+}
+
+static void
+apps_changed(GAppInfoMonitor *monitor, AppCache *cache)
+{
+  cache->generation++;
+  g_clear_pointer(&cache->apps, app_list_unref);
+}
+
+
+// External interface
+AppList*
+app_list_ref(AppList *list)
+{
+  g_return_val_if_fail(list != NULL, NULL);
+
+  g_atomic_int_inc(&list->ref_count);
+  return list;
+}
+
+void
+app_list_unref(AppList *list)
+{
+  g_return_if_fail(list != NULL);
+
+  if (!g_atomic_int_dec_and_test(&list->ref_count))
+    return;
+
+  g_hash_table_destroy(list->cmdlines);
+  g_hash_table_destroy(list->ids);
+  g_ptr_array_unref(list->apps);
+  g_slice_free(AppList, list);
+}
+
+// Returns index of app in list->apps or APP_LIST_NOT_FOUND
+gint
+app_list_find_id(AppList *list, const gchar *id)
+{
+  g_return_val_if_fail(list != NULL, APP_LIST_NOT_FOUND);
+
+  if (id == NULL)
+    return APP_LIST_NOT_FOUND;
+
+  return GPOINTER_TO_INT(g_hash_table_lookup(list->ids, id)) - 1;
+}
+
+// Command line has to be normalized with app_list_normalize_cmdline()
+gint
+app_list_find_cmdline(AppList *list, const gchar *cmdline)
+{
+  g_return_val_if_fail(list != NULL, APP_LIST_NOT_FOUND);
+
+  if (cmdline == NULL)
+    return APP_LIST_NOT_FOUND;
+
+  return GPOINTER_TO_INT(g_hash_table_lookup(list->cmdlines, cmdline)) - 1;
+}
+
+/* Drops .desktop Exec field codes and resolves program in PATH, so command
+ * line of installed app and path of its executable compare equal. */
+gchar*
+app_list_normalize_cmdline(const gchar *cmdline)
+{
+  gchar **argv, *program;
+  GString *normalized;
+
+  if (cmdline == NULL || !g_shell_parse_argv(cmdline, NULL, &argv, NULL))
+    return NULL;
+
+  program = g_find_program_in_path(argv[0]);
+  normalized = g_string_new(program ? program : argv[0]);
+  g_free(program);
+
+  for (guint i = 1; argv[i]; i++)
+  {
+    if (argv[i][0] == '%' && argv[i][1] != '\0' && argv[i][2] == '\0')
+      continue;
+    g_string_append_c(normalized, ' ');
+    g_string_append(normalized, argv[i]);
+  }
+  g_strfreev(argv);
+
+  return g_string_free(normalized, FALSE);
+}
+
+AppCache*
+app_cache_new(void)
+{
+  AppCache *cache = g_slice_new0(AppCache);
+
+  cache->waiting = g_queue_new();
+  cache->monitor = g_app_info_monitor_get();
+  cache->monitor_id = g_signal_connect(cache->monitor, "changed",
+                                       G_CALLBACK(apps_changed), cache);
+
+  return cache;
+}
+
+void
+app_cache_free(AppCache *cache)
+{
+  GTask *task;
+
+  if (cache == NULL)
+    return;
+
+  g_signal_handler_disconnect(cache->monitor, cache->monitor_id);
+  g_object_unref(cache->monitor);
+
+  if (cache->loading)
+  {
+    g_cancellable_cancel(cache->loading);
+    g_object_unref(cache->loading);
+  }
+
+  while ((task = g_queue_pop_head(cache->waiting)))
+  {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                            "Application cache destroyed");
+    g_object_unref(task);
+  }
+  g_queue_free(cache->waiting);
+
+  g_clear_pointer(&cache->apps, app_list_unref);
+
+  g_slice_free(AppCache, cache);
+}
+
+/* Result is returned from main loop, even if apps are already loaded, so
+ * callers can rely on callback not being invoked before this function returns. */
+void
+app_cache_get_apps_async(AppCache *cache, GCancellable *cancellable,
+                         GAsyncReadyCallback callback, gpointer user_data)
+{
+  GTask *task;
+
+  g_return_if_fail(cache != NULL);
+
+  task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, app_cache_get_apps_async);
+
+  if (cache->apps)
+  {
+    g_task_return_pointer(task, app_list_ref(cache->apps),
+                          (GDestroyNotify) app_list_unref);
+    g_object_unref(task);
+    return;
+  }
+
+  g_queue_push_tail(cache->waiting, task);
+  if (cache->loading == NULL)
+    app_cache_load(cache);
+}
+
+AppList*
+app_cache_get_apps_finish(GAsyncResult *result, GError **error)
+{
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == app_cache_get_apps_async,
+                       NULL);
+
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
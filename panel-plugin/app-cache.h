@@ -0,0 +1,53 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_APP_CACHE_H__
+#define __ALARM_PLUGIN_APP_CACHE_H__
+
+G_BEGIN_DECLS
+
+#define APP_LIST_NOT_FOUND -1
+
+typedef struct _AppList AppList;
+struct _AppList
+{
+  GPtrArray *apps; // GAppInfo* sorted by display name
+  GHashTable *ids; // app id => index in apps + 1
+  GHashTable *cmdlines; // normalized command line => index in apps + 1
+
+  gint ref_count;
+};
+
+typedef struct _AppCache AppCache;
+
+AppList* app_list_ref(AppList *list);
+void app_list_unref(AppList *list);
+gint app_list_find_id(AppList *list, const gchar *id);
+gint app_list_find_cmdline(AppList *list, const gchar *cmdline);
+gchar* app_list_normalize_cmdline(const gchar *cmdline);
+
+AppCache* app_cache_new(void);
+void app_cache_free(AppCache *cache);
+
+void app_cache_get_apps_async(AppCache *cache, GCancellable *cancellable,
+                              GAsyncReadyCallback callback, gpointer user_data);
+AppList* app_cache_get_apps_finish(GAsyncResult *result, GError **error);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_APP_CACHE_H__ */
@@ -0,0 +1,242 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "clock.h"
+
+/* Source of current time and of timeouts for everything time dependent:
+ * scheduler, alarm start times, recurrence and progress. System clock reads
+ * GLib clocks and arms main loop timeouts. Virtual clock stands still until
+ * advanced explicitly, and then dispatches due timers in deadline order with
+ * time set to each timer's deadline, so any span of time passes at once. */
+struct _Clock
+{
+  gboolean virtual;
+
+  // Virtual clock only
+  gint64 monotonic_time;
+  GDateTime *start; // Wall time at monotonic time 0
+  GHashTable *timers; // timer id => ClockTimer*
+  guint next_timer_id;
+};
+
+typedef struct
+{
+  gint64 deadline;
+  ClockFunc func;
+  gpointer user_data;
+} ClockTimer;
+
+
+// Utilities
+static void
+clock_timer_free(gpointer data)
+{
+  g_slice_free(ClockTimer, data);
+}
+
+// Returns id of earliest timer due at or before 'until', or CLOCK_NO_TIMER
+static guint
+clock_next_due(Clock *clock, gint64 until)
+{
+  GHashTableIter ht_iter;
+  gpointer timer_id;
+  ClockTimer *timer, *next = NULL;
+  guint next_id = CLOCK_NO_TIMER;
+
+  g_hash_table_iter_init(&ht_iter, clock->timers);
+  while (g_hash_table_iter_next(&ht_iter, &timer_id, (gpointer) &timer))
+  {
+    if (timer->deadline > until)
+      continue;
+
+    // Timers armed for the same deadline run in order of arming
+    if (next == NULL || timer->deadline < next->deadline ||
+        (timer->deadline == next->deadline && GPOINTER_TO_UINT(timer_id) < next_id))
+    {
+      next = timer;
+      next_id = GPOINTER_TO_UINT(timer_id);
+    }
+  }
+
+  return next_id;
+}
+
+
+// Callbacks
+static gboolean
+clock_timer_dispatch(gpointer data)
+{
+  ClockTimer *timer = data;
+
+  timer->func(timer->user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+// External interface
+Clock*
+clock_new(void)
+{
+  return g_slice_new0(Clock);
+}
+
+// Virtual clock starts at given wall time and monotonic time 0
+Clock*
+clock_new_virtual(GDateTime *start)
+{
+  Clock *clock;
+
+  g_return_val_if_fail(start != NULL, NULL);
+
+  clock = g_slice_new0(Clock);
+  clock->virtual = TRUE;
+  clock->start = g_date_time_to_utc(start);
+  clock->timers = g_hash_table_new_full(NULL, NULL, NULL, clock_timer_free);
+  clock->next_timer_id = CLOCK_NO_TIMER + 1;
+
+  return clock;
+}
+
+void
+clock_free(Clock *clock)
+{
+  if (clock == NULL)
+    return;
+
+  if (clock->virtual)
+  {
+    g_hash_table_destroy(clock->timers);
+    g_date_time_unref(clock->start);
+  }
+
+  g_slice_free(Clock, clock);
+}
+
+// Microseconds, comparable with deadlines passed to clock_arm()
+gint64
+clock_get_monotonic_time(Clock *clock)
+{
+  g_return_val_if_fail(clock != NULL, 0);
+
+  return clock->virtual ? clock->monotonic_time : g_get_monotonic_time();
+}
+
+// Returns new reference to current UTC time
+GDateTime*
+clock_get_now(Clock *clock)
+{
+  g_return_val_if_fail(clock != NULL, NULL);
+
+  if (clock->virtual)
+    return g_date_time_add(clock->start, clock->monotonic_time);
+
+  return g_date_time_new_now_utc();
+}
+
+/* Calls function once, at or after monotonic deadline. System clock uses
+ * second granularity, so GLib can coalesce this wakeup with other second
+ * based timeouts in the process. It rounds up, so timers never run early. */
+guint
+clock_arm(Clock *clock, gint64 deadline, ClockFunc func, gpointer user_data)
+{
+  ClockTimer *timer;
+  gint64 timeout;
+  guint timer_id;
+
+  g_return_val_if_fail(clock != NULL, CLOCK_NO_TIMER);
+  g_return_val_if_fail(func != NULL, CLOCK_NO_TIMER);
+
+  timer = g_slice_new(ClockTimer);
+  timer->deadline = deadline;
+  timer->func = func;
+  timer->user_data = user_data;
+
+  if (clock->virtual)
+  {
+    timer_id = clock->next_timer_id++;
+    g_hash_table_insert(clock->timers, GUINT_TO_POINTER(timer_id), timer);
+    return timer_id;
+  }
+
+  timeout = MAX(deadline - g_get_monotonic_time(), 0);
+  timeout = (timeout + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC;
+  return g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, (guint) MIN(timeout, G_MAXUINT),
+                                    clock_timer_dispatch, timer, clock_timer_free);
+}
+
+// Timer must not be disarmed after its function was called
+void
+clock_disarm(Clock *clock, guint timer_id)
+{
+  g_return_if_fail(clock != NULL);
+  g_return_if_fail(timer_id != CLOCK_NO_TIMER);
+
+  if (clock->virtual)
+    g_hash_table_remove(clock->timers, GUINT_TO_POINTER(timer_id));
+  else
+    g_source_remove(timer_id);
+}
+
+/* Moves virtual clock forward, running timers that fall due on the way.
+ * Timers armed by those functions run too, if they are due within span. */
+void
+clock_advance(Clock *clock, GTimeSpan span)
+{
+  ClockTimer *timer;
+  gint64 until;
+  guint timer_id;
+
+  g_return_if_fail(clock != NULL);
+  g_return_if_fail(clock->virtual);
+  g_return_if_fail(span >= 0);
+
+  until = clock->monotonic_time + span;
+  while ((timer_id = clock_next_due(clock, until)) != CLOCK_NO_TIMER)
+  {
+    timer = g_hash_table_lookup(clock->timers, GUINT_TO_POINTER(timer_id));
+    g_hash_table_steal(clock->timers, GUINT_TO_POINTER(timer_id));
+    clock->monotonic_time = MAX(clock->monotonic_time, timer->deadline);
+    timer->func(timer->user_data);
+    clock_timer_free(timer);
+  }
+  clock->monotonic_time = until;
+}
+
+/* Moves virtual wall clock forward while monotonic time stands still, as it
+ * does while system is suspended. No timers run. */
+void
+clock_suspend(Clock *clock, GTimeSpan span)
+{
+  GDateTime *start;
+
+  g_return_if_fail(clock != NULL);
+  g_return_if_fail(clock->virtual);
+  g_return_if_fail(span >= 0);
+
+  start = g_date_time_add(clock->start, span);
+  g_date_time_unref(clock->start);
+  clock->start = start;
+}
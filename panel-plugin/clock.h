@@ -0,0 +1,46 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __ALARM_PLUGIN_CLOCK_H__
+#define __ALARM_PLUGIN_CLOCK_H__
+
+G_BEGIN_DECLS
+
+#define CLOCK_NO_TIMER 0
+
+typedef void (*ClockFunc) (gpointer user_data);
+
+typedef struct _Clock Clock;
+
+Clock* clock_new(void);
+Clock* clock_new_virtual(GDateTime *start);
+void clock_free(Clock *clock);
+
+gint64 clock_get_monotonic_time(Clock *clock);
+GDateTime* clock_get_now(Clock *clock);
+
+guint clock_arm(Clock *clock, gint64 deadline, ClockFunc func, gpointer user_data);
+void clock_disarm(Clock *clock, guint timer_id);
+
+void clock_advance(Clock *clock, GTimeSpan span);
+void clock_suspend(Clock *clock, GTimeSpan span);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_CLOCK_H__ */
@@ -19,156 +19,16 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
-#ifdef HAVE_MATH_H
-#include <math.h>
-#endif
 
-#include <libxfce4panel/xfce-panel-plugin.h>
-#include <libxfce4ui/libxfce4ui.h>
-#include <xfconf/xfconf.h>
+#include <glib-object.h>
 
+#include "profiler.h"
+#include "xfconf-batch.h"
 #include "common.h"
 
-// GTK
-GtkBuilder*
-alarm_builder_new(XfcePanelPlugin *panel_plugin,
-                  const gchar *weak_ref_id, GObject **weak_ref_obj,
-                  const gchar* first_buffer, gsize first_buffer_length, ...)
-{
-  GtkBuilder *builder;
-  GError *error = NULL;
-  va_list var_args;
-  const gchar *buffer = first_buffer;
-  gsize buffer_length = first_buffer_length;
-
-  g_return_val_if_fail(XFCE_IS_PANEL_PLUGIN(panel_plugin), NULL);
-  g_return_val_if_fail(first_buffer != NULL, NULL);
-  g_return_val_if_fail(first_buffer_length > 0, NULL);
-
-  /* Hack to make sure GtkBuilder knows about the XfceTitledDialog object
-   * https://wiki.xfce.org/releng/4.8/roadmap/libxfce4ui
-   * http://bugzilla.gnome.org/show_bug.cgi?id=588238 */
-  if (xfce_titled_dialog_get_type() == 0) return NULL;
-
-  builder = gtk_builder_new();
-
-  va_start(var_args, first_buffer_length);
-  while (buffer != NULL)
-  {
-    if (!gtk_builder_add_from_string(builder, buffer, buffer_length, &error))
-    {
-      g_critical("Failed to construct the builder for plugin %s-%d: %s.",
-                 xfce_panel_plugin_get_name (panel_plugin),
-                 xfce_panel_plugin_get_unique_id (panel_plugin),
-                 error->message);
-      g_error_free(error);
-      g_object_unref(builder);
-      return NULL;
-    }
-
-    buffer = va_arg(var_args, gchar*);
-    if (buffer != NULL)
-      buffer_length = va_arg(var_args, gsize);
-  }
-  va_end(var_args);
-
-  *weak_ref_obj = gtk_builder_get_object(builder, weak_ref_id);
-  if (GTK_IS_WIDGET(*weak_ref_obj))
-    // TODO: builder should be saved in structure Plugin/Alarm like in Alert and
-    // destroyed from there instead of by data binding here (or builder pointer
-    // can be passed as argument and weak_ref clearing it set here)
-    g_object_set_data_full(*weak_ref_obj, "builder", builder, g_object_unref);
-  else
-    g_clear_object(&builder);
-
-  return builder;
-}
-
-void
-set_sensitive(GtkBuilder *builder, gboolean sensitive, const gchar *first_widget_id, ...)
-{
-  va_list var_args;
-  const gchar *widget_id = first_widget_id;
-  GObject *object;
-
-  g_return_if_fail(GTK_IS_BUILDER(builder));
-  g_return_if_fail(first_widget_id != NULL);
-
-  va_start(var_args, first_widget_id);
-  while (widget_id != NULL)
-  {
-    object = gtk_builder_get_object(builder, widget_id);
-    g_return_if_fail(GTK_IS_WIDGET(object));
-    gtk_widget_set_sensitive(GTK_WIDGET(object), sensitive);
-
-    widget_id = va_arg(var_args, gchar*);
-  }
-  va_end(var_args);
-}
-
-gint
-time_spin_input(GtkSpinButton *button, gdouble *new_value)
-{
-  const gchar *time;
-  gchar *error = NULL, **parts;
-  gint pos = 0;
-  gboolean zero_inf;
-
-  g_return_val_if_fail(GTK_IS_SPIN_BUTTON(button), FALSE);
-
-  time = gtk_entry_get_text(GTK_ENTRY(button));
-  if (time == NULL)
-    return GTK_INPUT_ERROR;
-
-  zero_inf = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(button), "zero-is-infinity"));
-  if (zero_inf && !g_strcmp0(time, UNICODE_INFINITY))
-  {
-    *new_value = 0;
-    return TRUE;
-  }
-
-  parts = g_strsplit_set(time, ":,.;- ", 3);
-  do
-  {
-    *new_value = 60*(*new_value) + g_strtod(parts[pos], &error);
-    pos++;
-  }
-  while ((parts[pos] != NULL) && (*error == '\0'));
-  g_strfreev(parts);
-
-  *new_value *= pow(60, 3 - pos);
-
-  if (error != NULL)
-    return GTK_INPUT_ERROR;
-  else
-    return TRUE;
-}
-
-gboolean
-time_spin_output(GtkSpinButton *button)
-{
-  gint value;
-  gchar *time;
-  gboolean zero_inf;
-
-  g_return_val_if_fail(GTK_IS_SPIN_BUTTON(button), FALSE);
-
-  value = gtk_spin_button_get_value(button);
-  zero_inf = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(button), "zero-is-infinity"));
-  if (zero_inf && value == 0)
-    time = g_strdup(UNICODE_INFINITY);
-  else
-    time = g_strdup_printf("%02u:%02u:%02u", value/3600, value%3600/60, value%60);
-
-  if (g_strcmp0(time, gtk_entry_get_text(GTK_ENTRY(button))))
-    gtk_entry_set_text(GTK_ENTRY(button), time);
-  g_free(time);
-
-  return TRUE;
-}
-
-
 // GObject
+/* Copies configuration properties only, runtime state (flagged with
+ * XFCONF_BATCH_PARAM_RUNTIME) stays with the destination object. */
 void
 g_object_copy(GObject *src, GObject *dst)
 {
@@ -189,10 +49,12 @@ g_object_copy(GObject *src, GObject *dst)
   values = g_new0(GValue, spec_count);
   for (i = 0; i < spec_count; i++)
   {
-    if ((specs[i]->flags & G_PARAM_READWRITE) == 0)
+    if ((specs[i]->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+        (specs[i]->flags & XFCONF_BATCH_PARAM_RUNTIME))
       continue;
 
     names[prop_count] = g_param_spec_get_name(specs[i]);
+    g_value_init(&values[prop_count], specs[i]->value_type);
     g_object_get_property(src, names[prop_count], &values[prop_count]);
 
     prop_count++;
@@ -223,29 +85,3 @@ g_object_dup(GObject *src)
   return (gpointer) dst;
 }
 
-
-// Xfconf
-void
-xfconf_channel_set_object(XfconfChannel *channel, const gchar *prefix, GObject *object)
-{
-  GParamSpec **specs;
-  guint spec_count, i;
-  gchar *property_name;
-  GValue property_value = G_VALUE_INIT;
-
-  g_return_if_fail(object != NULL);
-
-  specs = g_object_class_list_properties(G_OBJECT_GET_CLASS(object), &spec_count);
-
-  for (i = 0; i < spec_count; i++)
-  {
-    if ((specs[i]->flags & G_PARAM_READWRITE) == 0)
-      continue;
-
-    property_name = g_strdup_printf("%s/%s", prefix, g_param_spec_get_name(specs[i]));
-    g_object_get_property(object, g_param_spec_get_name(specs[i]), &property_value);
-    g_warn_if_fail(xfconf_channel_set_property(channel, property_name, &property_value));
-    g_free(property_name);
-    g_value_unset(&property_value);
-  }
-}
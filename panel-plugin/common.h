@@ -19,20 +19,7 @@
 #ifndef __ALARM_PLUGIN_COMMON_H__
 #define __ALARM_PLUGIN_COMMON_H__
 
-#define UNICODE_INFINITY "\xe2\x88\x9e"
-
-GtkBuilder* alarm_builder_new(XfcePanelPlugin *panel_plugin,
-                              const gchar *weak_ref_id, GObject **weak_ref_obj,
-                              const gchar* first_buffer, gsize first_buffer_length, ...);
-void set_sensitive(GtkBuilder *builder, gboolean sensitive,
-                   const gchar *first_widget_id, ...);
-gint time_spin_input(GtkSpinButton *button, gdouble *new_value);
-gboolean time_spin_output(GtkSpinButton *button);
-
 void g_object_copy(GObject *src, GObject *dst);
 gpointer g_object_dup(GObject *src);
 
-void xfconf_channel_set_object(XfconfChannel *channel, const gchar *prefix,
-                               GObject *object);
-
 #endif /* !__ALARM_PLUGIN_COMMON_H__ */
@@ -0,0 +1,255 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "journal.h"
+
+// Records appended since last compaction, above which journal is compacted
+#define JOURNAL_COMPACT_THRESHOLD 256
+
+/* Append-only log of alarm runtime events, one record per line:
+ *   <event> <alarm id> <unix time in microseconds>
+ * Starting and stopping alarm costs a single small write to local file, never
+ * an xfconf round trip. Journal is replayed on open to restore alarms running
+ * when panel exited or crashed. Truncated or malformed records (e.g. the last
+ * one after crash) are skipped. Journal is rewritten with only start records
+ * of running alarms on open and once enough records accumulate. */
+struct _Journal
+{
+  gchar *filename;
+  GOutputStream *stream; // NULL if journal file cannot be written
+
+  GHashTable *started; // alarm id => start time (gint64*), for running alarms
+  guint records; // Appended since last compaction
+  guint compact_id; // Idle source compacting journal
+};
+
+
+// Utilities
+static void
+journal_apply(Journal *journal, JournalEvent event, guint alarm_id, gint64 time)
+{
+  gint64 *started_at;
+
+  switch (event)
+  {
+    case JOURNAL_START:
+      started_at = g_new(gint64, 1);
+      *started_at = time;
+      g_hash_table_insert(journal->started, GUINT_TO_POINTER(alarm_id), started_at);
+      break;
+
+    case JOURNAL_STOP:
+      g_hash_table_remove(journal->started, GUINT_TO_POINTER(alarm_id));
+      break;
+
+    // Firing and acknowledging alerts do not change running state
+    case JOURNAL_FIRE:
+    case JOURNAL_ACK:
+      break;
+  }
+}
+
+static void
+journal_replay(Journal *journal)
+{
+  gchar *contents, **lines;
+  gchar event;
+  guint alarm_id;
+  gint64 time;
+  GError *error = NULL;
+
+  if (!g_file_get_contents(journal->filename, &contents, NULL, &error))
+  {
+    if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_message("Failed to read journal: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  lines = g_strsplit(contents, "\n", -1);
+  g_free(contents);
+  for (guint i = 0; lines[i]; i++)
+    if (sscanf(lines[i], "%c %u %" G_GINT64_FORMAT, &event, &alarm_id, &time) == 3)
+      journal_apply(journal, event, alarm_id, time);
+  g_strfreev(lines);
+}
+
+static void
+journal_open_stream(Journal *journal)
+{
+  GFile *file;
+  GError *error = NULL;
+
+  g_clear_object(&journal->stream);
+
+  file = g_file_new_for_path(journal->filename);
+  journal->stream = G_OUTPUT_STREAM(g_file_append_to(file, G_FILE_CREATE_PRIVATE, NULL,
+                                                     &error));
+  g_object_unref(file);
+
+  if (journal->stream == NULL)
+  {
+    g_message("Failed to open journal: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+static gboolean
+journal_compact_idle(gpointer data)
+{
+  Journal *journal = data;
+
+  journal->compact_id = 0;
+  journal_compact(journal);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+// External interface
+/* Directory of journal is created if missing. Failure to write journal is
+ * not fatal - state is still tracked in memory. */
+Journal*
+journal_open(const gchar *filename)
+{
+  Journal *journal;
+  gchar *dirname;
+
+  g_return_val_if_fail(filename != NULL, NULL);
+
+  journal = g_slice_new0(Journal);
+  journal->filename = g_strdup(filename);
+  journal->started = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+  dirname = g_path_get_dirname(filename);
+  if (g_mkdir_with_parents(dirname, 0700))
+    g_message("Failed to create journal directory: %s", dirname);
+  g_free(dirname);
+
+  journal_replay(journal);
+  journal_compact(journal);
+
+  return journal;
+}
+
+void
+journal_close(Journal *journal)
+{
+  if (journal == NULL)
+    return;
+
+  if (journal->compact_id)
+    g_source_remove(journal->compact_id);
+  g_clear_object(&journal->stream);
+  g_hash_table_destroy(journal->started);
+  g_free(journal->filename);
+
+  g_slice_free(Journal, journal);
+}
+
+void
+journal_append(Journal *journal, JournalEvent event, guint alarm_id, GDateTime *time)
+{
+  gchar record[64];
+  gint64 unix_time;
+  gint length;
+  GError *error = NULL;
+
+  g_return_if_fail(journal != NULL);
+  g_return_if_fail(time != NULL);
+
+  unix_time = g_date_time_to_unix(time) * G_USEC_PER_SEC +
+    g_date_time_get_microsecond(time);
+  journal_apply(journal, event, alarm_id, unix_time);
+
+  if (journal->stream == NULL)
+    return;
+
+  // Whole record in single write, so crash leaves at most one partial line
+  length = g_snprintf(record, sizeof(record), "%c %u %" G_GINT64_FORMAT "\n",
+                      event, alarm_id, unix_time);
+  if (!g_output_stream_write_all(journal->stream, record, length, NULL, NULL, &error))
+  {
+    g_message("Failed to write journal: %s", error->message);
+    g_error_free(error);
+    g_clear_object(&journal->stream);
+    return;
+  }
+
+  if (++journal->records > JOURNAL_COMPACT_THRESHOLD && journal->compact_id == 0)
+    journal->compact_id = g_idle_add(journal_compact_idle, journal);
+}
+
+// Returns start time of running alarm or NULL
+GDateTime*
+journal_get_started_at(Journal *journal, guint alarm_id)
+{
+  gint64 *started_at;
+  GDateTime *epoch, *time;
+
+  g_return_val_if_fail(journal != NULL, NULL);
+
+  started_at = g_hash_table_lookup(journal->started, GUINT_TO_POINTER(alarm_id));
+  if (started_at == NULL)
+    return NULL;
+
+  epoch = g_date_time_new_from_unix_utc(0);
+  time = g_date_time_add(epoch, *started_at);
+  g_date_time_unref(epoch);
+
+  return time;
+}
+
+// Atomically replaces journal with start records of running alarms only
+void
+journal_compact(Journal *journal)
+{
+  GString *contents;
+  GHashTableIter ht_iter;
+  gpointer alarm_id;
+  gint64 *started_at;
+  GError *error = NULL;
+
+  g_return_if_fail(journal != NULL);
+
+  contents = g_string_new(NULL);
+  g_hash_table_iter_init(&ht_iter, journal->started);
+  while (g_hash_table_iter_next(&ht_iter, &alarm_id, (gpointer) &started_at))
+    g_string_append_printf(contents, "%c %u %" G_GINT64_FORMAT "\n", JOURNAL_START,
+                           GPOINTER_TO_UINT(alarm_id), *started_at);
+
+  if (!g_file_set_contents(journal->filename, contents->str, contents->len, &error))
+  {
+    g_message("Failed to compact journal: %s", error->message);
+    g_error_free(error);
+  }
+  else
+    journal->records = 0;
+  g_string_free(contents, TRUE);
+
+  // Stream still points to replaced file
+  journal_open_stream(journal);
+}
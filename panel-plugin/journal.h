@@ -0,0 +1,43 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_JOURNAL_H__
+#define __ALARM_PLUGIN_JOURNAL_H__
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  JOURNAL_START = 'S',
+  JOURNAL_STOP = 'E',
+  JOURNAL_FIRE = 'F',
+  JOURNAL_ACK = 'A'
+} JournalEvent;
+
+typedef struct _Journal Journal;
+
+Journal* journal_open(const gchar *filename);
+void journal_close(Journal *journal);
+
+void journal_append(Journal *journal, JournalEvent event, guint alarm_id, GDateTime *time);
+GDateTime* journal_get_started_at(Journal *journal, guint alarm_id);
+void journal_compact(Journal *journal);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_JOURNAL_H__ */
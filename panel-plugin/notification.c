@@ -0,0 +1,471 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <glib/gi18n-lib.h>
+
+#include "clock.h"
+#include "scheduler.h"
+#include "notification.h"
+
+#define NOTIFICATIONS_NAME "org.freedesktop.Notifications"
+#define NOTIFICATIONS_PATH "/org/freedesktop/Notifications"
+#define NOTIFICATIONS_INTERFACE "org.freedesktop.Notifications"
+#define NOTIFICATION_APP_NAME "xfce4-alarm-plugin"
+#define NOTIFICATION_ICON_NAME "xfce4-alarm-plugin-clock"
+#define NOTIFICATION_ACTION_STOP "stop"
+#define NOTIFICATION_CLOSED_DISMISSED 2 // NotificationClosed reason
+
+// Token bucket: up to NOTIFIER_BURST notifications at once, then 1 per NOTIFIER_REFILL s
+#define NOTIFIER_BURST 4.0
+#define NOTIFIER_REFILL 2
+
+/* Desktop notifications through org.freedesktop.Notifications. Single proxy
+ * is created on first notification and kept for plugin lifetime; all calls
+ * are asynchronous, so unavailable notification daemon never stalls alerts.
+ * Notifications are identified by handles local to plugin. Showing
+ * notification again under the same handle replaces bubble on screen
+ * (replaces_id) instead of stacking new one, so update waits in queue until
+ * daemon tells id of the bubble it replaces. Notifications exceeding rate
+ * limit wait in queue as well, where updates of the same handle are merged.
+ * Bubble dismissed by user or its Stop action is reported to dismissed func. */
+struct _Notifier
+{
+  Scheduler *scheduler; // Key: Notifier* for token refill
+  GDBusProxy *proxy; // NULL until connected
+  gboolean connecting;
+  GCancellable *cancellable; // Cancels pending calls once notifier is freed
+
+  GHashTable *notifications; // handle => Notification*
+  guint next_handle;
+  GQueue *pending; // Notification* waiting for proxy, rate limit or id
+  NotifierFunc dismissed;
+  gpointer dismissed_data;
+
+  gdouble tokens;
+  gint64 refilled_at;
+};
+
+typedef struct
+{
+  Notifier *notifier;
+  guint handle;
+  guint id; // Assigned by notification daemon, 0 until shown
+  gchar *summary;
+  gchar *body;
+  gboolean pending;
+  gboolean sending; // Notify call in flight, id not known yet
+  gboolean closed;
+
+  // Held by notifier->notifications, pending queue and Notify call
+  gint ref_count;
+} Notification;
+
+
+// Utilities
+static Notification*
+notification_ref(Notification *notification)
+{
+  notification->ref_count++;
+  return notification;
+}
+
+static void
+notification_unref(Notification *notification)
+{
+  if (--notification->ref_count)
+    return;
+
+  g_free(notification->summary);
+  g_free(notification->body);
+  g_slice_free(Notification, notification);
+}
+
+static gboolean
+notifier_take_token(Notifier *notifier)
+{
+  gint64 now = scheduler_get_time(notifier->scheduler);
+
+  notifier->tokens = MIN(NOTIFIER_BURST, notifier->tokens + (gdouble)
+                         (now - notifier->refilled_at) / (NOTIFIER_REFILL * G_USEC_PER_SEC));
+  notifier->refilled_at = now;
+
+  if (notifier->tokens < 1.0)
+    return FALSE;
+
+  notifier->tokens -= 1.0;
+  return TRUE;
+}
+
+static void notification_sent(GObject *source_object, GAsyncResult *result, gpointer data);
+
+static void
+notification_send(Notifier *notifier, Notification *notification)
+{
+  const gchar *actions[] = {NOTIFICATION_ACTION_STOP, _("Stop")};
+  GVariant *parameters;
+
+  parameters = g_variant_new("(susss@as@a{sv}i)", NOTIFICATION_APP_NAME, notification->id,
+                             NOTIFICATION_ICON_NAME, notification->summary,
+                             notification->body ? notification->body : "",
+                             g_variant_new_strv(actions, G_N_ELEMENTS(actions)),
+                             g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0), -1);
+  notification->sending = TRUE;
+  g_dbus_proxy_call(notifier->proxy, "Notify", parameters, G_DBUS_CALL_FLAGS_NONE, -1,
+                    notifier->cancellable, notification_sent, notification_ref(notification));
+}
+
+static void
+notification_send_close(Notifier *notifier, guint id)
+{
+  g_dbus_proxy_call(notifier->proxy, "CloseNotification", g_variant_new("(u)", id),
+                    G_DBUS_CALL_FLAGS_NONE, -1, notifier->cancellable, NULL, NULL);
+}
+
+static void refill_due(gpointer key, gpointer user_data);
+
+static void
+notifier_flush(Notifier *notifier)
+{
+  Notification *notification;
+  GList *link, *next;
+  gboolean limited = FALSE;
+  gint64 deadline;
+
+  if (notifier->proxy == NULL)
+    return;
+
+  for (link = notifier->pending->head; link != NULL; link = next)
+  {
+    next = link->next;
+    notification = link->data;
+
+    // Sent again once reply to previous Notify tells which bubble to replace
+    if (notification->sending)
+      continue;
+
+    limited = !notifier_take_token(notifier);
+    if (limited)
+      break;
+
+    g_queue_delete_link(notifier->pending, link);
+    notification->pending = FALSE;
+    notification_send(notifier, notification);
+    notification_unref(notification);
+  }
+
+  if (!limited)
+    return;
+
+  deadline = notifier->refilled_at +
+    (gint64) ((1.0 - notifier->tokens) * NOTIFIER_REFILL * G_USEC_PER_SEC);
+  scheduler_add(notifier->scheduler, notifier, deadline, refill_due, NULL);
+}
+
+static void proxy_ready(GObject *source_object, GAsyncResult *result, gpointer data);
+static void proxy_signal(GDBusProxy *proxy, const gchar *sender_name,
+                         const gchar *signal_name, GVariant *parameters, Notifier *notifier);
+
+static void
+notifier_connect(Notifier *notifier)
+{
+  // Notification daemon is activated on first call, not on connection
+  notifier->connecting = TRUE;
+  g_dbus_proxy_new_for_bus(G_BUS_TYPE_SESSION,
+                           G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                           G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+                           NULL, NOTIFICATIONS_NAME, NOTIFICATIONS_PATH,
+                           NOTIFICATIONS_INTERFACE, notifier->cancellable,
+                           proxy_ready, notifier);
+}
+
+
+// Callbacks
+static void
+proxy_ready(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+  Notifier *notifier;
+  Notification *notification;
+  GDBusProxy *proxy;
+  GError *error = NULL;
+
+  // Notifier is already freed if connecting has been cancelled
+  proxy = g_dbus_proxy_new_for_bus_finish(result, &error);
+  if (proxy == NULL && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+  {
+    g_error_free(error);
+    return;
+  }
+
+  notifier = data;
+  notifier->connecting = FALSE;
+
+  if (proxy == NULL)
+  {
+    // Queued notifications are dropped, next one retries connecting
+    g_message("Failed to connect to notification daemon: %s", error->message);
+    g_error_free(error);
+    while ((notification = g_queue_pop_head(notifier->pending)))
+    {
+      notification->pending = FALSE;
+      notification_unref(notification);
+    }
+    return;
+  }
+
+  notifier->proxy = proxy;
+  g_signal_connect(proxy, "g-signal", G_CALLBACK(proxy_signal), notifier);
+  notifier_flush(notifier);
+}
+
+static void
+proxy_signal(GDBusProxy *proxy, const gchar *sender_name, const gchar *signal_name,
+             GVariant *parameters, Notifier *notifier)
+{
+  Notification *notification = NULL;
+  GHashTableIter ht_iter;
+  gpointer candidate;
+  guint id, reason;
+  gboolean dismissed;
+
+  if (!g_strcmp0(signal_name, "NotificationClosed") &&
+      g_variant_is_of_type(parameters, G_VARIANT_TYPE("(uu)")))
+  {
+    g_variant_get(parameters, "(uu)", &id, &reason);
+    dismissed = reason == NOTIFICATION_CLOSED_DISMISSED;
+  }
+  else if (!g_strcmp0(signal_name, "ActionInvoked") &&
+           g_variant_is_of_type(parameters, G_VARIANT_TYPE("(us)")))
+  {
+    g_variant_get(parameters, "(us)", &id, NULL);
+    dismissed = TRUE;
+  }
+  else
+    return;
+
+  // Daemon ids are shared by all its clients
+  g_hash_table_iter_init(&ht_iter, notifier->notifications);
+  while (id != 0 && g_hash_table_iter_next(&ht_iter, NULL, &candidate))
+    if (((Notification*) candidate)->id == id)
+    {
+      notification = candidate;
+      break;
+    }
+  if (notification == NULL)
+    return;
+
+  // Expired bubble cannot be replaced anymore, next update shows new one
+  if (!g_strcmp0(signal_name, "NotificationClosed"))
+    notification->id = 0;
+
+  if (dismissed && notifier->dismissed)
+    notifier->dismissed(notification->handle, notifier->dismissed_data);
+}
+
+static void
+notification_sent(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+  Notification *notification = data;
+  Notifier *notifier;
+  GVariant *reply;
+  GError *error = NULL;
+
+  reply = g_dbus_proxy_call_finish(G_DBUS_PROXY(source_object), result, &error);
+  if (reply == NULL && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+  {
+    // Notifier is already freed if call has been cancelled
+    g_error_free(error);
+    notification_unref(notification);
+    return;
+  }
+
+  notifier = notification->notifier;
+  notification->sending = FALSE;
+
+  if (reply == NULL)
+  {
+    g_message("Failed to show notification: %s", error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    g_variant_get(reply, "(u)", &notification->id);
+    g_variant_unref(reply);
+
+    // Closed before daemon told its id
+    if (notification->closed)
+      notification_send_close(notifier, notification->id);
+  }
+
+  // Update queued while waiting for id
+  if (notification->pending)
+    notifier_flush(notifier);
+
+  notification_unref(notification);
+}
+
+static void
+refill_due(gpointer key, gpointer user_data)
+{
+  notifier_flush(key);
+}
+
+
+// External interface
+Notifier*
+notifier_new(Scheduler *scheduler)
+{
+  Notifier *notifier;
+
+  g_return_val_if_fail(scheduler != NULL, NULL);
+
+  notifier = g_slice_new0(Notifier);
+  notifier->scheduler = scheduler;
+  notifier->cancellable = g_cancellable_new();
+  notifier->notifications = g_hash_table_new_full(NULL, NULL, NULL,
+                                                  (GDestroyNotify) notification_unref);
+  notifier->next_handle = NOTIFIER_NO_NOTIFICATION + 1;
+  notifier->pending = g_queue_new();
+  notifier->tokens = NOTIFIER_BURST;
+  notifier->refilled_at = scheduler_get_time(notifier->scheduler);
+
+  return notifier;
+}
+
+// Has to be called before scheduler is freed. Notifications on screen are kept.
+void
+notifier_free(Notifier *notifier)
+{
+  Notification *notification;
+
+  if (notifier == NULL)
+    return;
+
+  g_cancellable_cancel(notifier->cancellable);
+  g_object_unref(notifier->cancellable);
+  scheduler_remove(notifier->scheduler, notifier);
+
+  while ((notification = g_queue_pop_head(notifier->pending)))
+  {
+    notification->pending = FALSE;
+    notification_unref(notification);
+  }
+  g_queue_free(notifier->pending);
+  g_hash_table_destroy(notifier->notifications);
+
+  if (notifier->proxy)
+    g_signal_handlers_disconnect_by_data(notifier->proxy, notifier);
+  g_clear_object(&notifier->proxy);
+
+  g_slice_free(Notifier, notifier);
+}
+
+// Func is called with handle of notification dismissed by user
+void
+notifier_set_dismissed_func(Notifier *notifier, NotifierFunc func, gpointer user_data)
+{
+  g_return_if_fail(notifier != NULL);
+
+  notifier->dismissed = func;
+  notifier->dismissed_data = user_data;
+}
+
+/* Shows notification under handle, replacing one shown before. Returns handle
+ * to use for updates, NOTIFIER_NO_NOTIFICATION creates new one. */
+guint
+notifier_show(Notifier *notifier, guint handle, const gchar *summary, const gchar *body)
+{
+  Notification *notification;
+
+  g_return_val_if_fail(notifier != NULL, NOTIFIER_NO_NOTIFICATION);
+  g_return_val_if_fail(summary != NULL, NOTIFIER_NO_NOTIFICATION);
+
+  notification = g_hash_table_lookup(notifier->notifications, GUINT_TO_POINTER(handle));
+  if (notification == NULL)
+  {
+    notification = g_slice_new0(Notification);
+    notification->notifier = notifier;
+    notification->handle = notifier->next_handle++;
+    notification->ref_count = 1;
+    g_hash_table_insert(notifier->notifications, GUINT_TO_POINTER(notification->handle),
+                        notification);
+  }
+
+  g_free(notification->summary);
+  notification->summary = g_strdup(summary);
+  g_free(notification->body);
+  notification->body = g_strdup(body);
+
+  if (!notification->pending)
+  {
+    notification->pending = TRUE;
+    g_queue_push_tail(notifier->pending, notification_ref(notification));
+  }
+
+  if (notifier->proxy)
+    notifier_flush(notifier);
+  else if (!notifier->connecting)
+    notifier_connect(notifier);
+
+  return notification->handle;
+}
+
+// Removes notification from screen and releases handle
+void
+notifier_close(Notifier *notifier, guint handle)
+{
+  Notification *notification;
+
+  g_return_if_fail(notifier != NULL);
+
+  notification = g_hash_table_lookup(notifier->notifications, GUINT_TO_POINTER(handle));
+  if (notification == NULL)
+    return;
+
+  notification->closed = TRUE;
+  if (notification->id && notifier->proxy)
+    notification_send_close(notifier, notification->id);
+
+  notifier_release(notifier, handle);
+}
+
+// Forgets handle, notification stays on screen until dismissed
+void
+notifier_release(Notifier *notifier, guint handle)
+{
+  Notification *notification;
+
+  g_return_if_fail(notifier != NULL);
+
+  notification = g_hash_table_lookup(notifier->notifications, GUINT_TO_POINTER(handle));
+  if (notification == NULL)
+    return;
+
+  if (notification->pending)
+  {
+    g_queue_remove(notifier->pending, notification);
+    notification->pending = FALSE;
+    notification_unref(notification);
+  }
+
+  g_hash_table_remove(notifier->notifications, GUINT_TO_POINTER(handle));
+}
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_NOTIFICATION_H__
+#define __ALARM_PLUGIN_NOTIFICATION_H__
+
+G_BEGIN_DECLS
+
+#define NOTIFIER_NO_NOTIFICATION 0
+
+typedef void (*NotifierFunc) (guint handle, gpointer user_data);
+
+typedef struct _Notifier Notifier;
+
+Notifier* notifier_new(Scheduler *scheduler);
+void notifier_free(Notifier *notifier);
+
+void notifier_set_dismissed_func(Notifier *notifier, NotifierFunc func, gpointer user_data);
+
+guint notifier_show(Notifier *notifier, guint handle, const gchar *summary,
+                    const gchar *body);
+void notifier_close(Notifier *notifier, guint handle);
+void notifier_release(Notifier *notifier, guint handle);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_NOTIFICATION_H__ */
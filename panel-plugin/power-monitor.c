@@ -0,0 +1,200 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <glib/gstdio.h>
+
+#include "power-monitor.h"
+
+#define LOGIND_NAME "org.freedesktop.login1"
+#define LOGIND_PATH "/org/freedesktop/login1"
+#define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+
+#define NO_INHIBITOR -1
+
+/* Watches logind PrepareForSleep signal on system bus. Delay inhibitor lock
+ * is held while awake, so suspend waits until plugin has handled it; lock is
+ * released right after and taken again on resume. System bus address is
+ * taken from DBUS_SYSTEM_BUS_ADDRESS, if set, so mock logind on private bus
+ * can stand in for the real one. */
+struct _PowerMonitor
+{
+  GDBusConnection *connection; // NULL until connected
+  guint subscription_id;
+  gint inhibitor; // File descriptor of delay lock or NO_INHIBITOR
+  GCancellable *cancellable; // Cancels pending calls once monitor is freed
+
+  PowerMonitorFunc func;
+  gpointer user_data;
+};
+
+
+// Utilities
+static void
+power_monitor_uninhibit(PowerMonitor *monitor)
+{
+  if (monitor->inhibitor == NO_INHIBITOR)
+    return;
+
+  g_close(monitor->inhibitor, NULL);
+  monitor->inhibitor = NO_INHIBITOR;
+}
+
+static void inhibited(GObject *source_object, GAsyncResult *result, gpointer data);
+
+static void
+power_monitor_inhibit(PowerMonitor *monitor)
+{
+  g_dbus_connection_call_with_unix_fd_list(monitor->connection, LOGIND_NAME, LOGIND_PATH,
+                                           LOGIND_MANAGER_INTERFACE, "Inhibit",
+                                           g_variant_new("(ssss)", "sleep",
+                                                         "Xfce Alarm Plugin",
+                                                         "Stopping alarms before suspend",
+                                                         "delay"),
+                                           G_VARIANT_TYPE("(h)"), G_DBUS_CALL_FLAGS_NONE,
+                                           -1, NULL, monitor->cancellable, inhibited,
+                                           monitor);
+}
+
+
+// Callbacks
+static void
+inhibited(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+  PowerMonitor *monitor;
+  GUnixFDList *fd_list = NULL;
+  GVariant *reply;
+  GError *error = NULL;
+  gint fd_index;
+
+  // Monitor is already freed if call has been cancelled
+  reply = g_dbus_connection_call_with_unix_fd_list_finish(G_DBUS_CONNECTION(source_object),
+                                                          &fd_list, result, &error);
+  if (reply == NULL)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_message("Failed to take suspend delay lock: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  monitor = data;
+  g_variant_get(reply, "(h)", &fd_index);
+  g_variant_unref(reply);
+
+  // Lock taken twice (quick suspend/resume) is kept once
+  power_monitor_uninhibit(monitor);
+  monitor->inhibitor = g_unix_fd_list_get(fd_list, fd_index, &error);
+  if (monitor->inhibitor == NO_INHIBITOR)
+  {
+    g_message("Failed to take suspend delay lock: %s", error->message);
+    g_error_free(error);
+  }
+  g_object_unref(fd_list);
+}
+
+static void
+prepare_for_sleep(GDBusConnection *connection, const gchar *sender_name,
+                  const gchar *object_path, const gchar *interface_name,
+                  const gchar *signal_name, GVariant *parameters, gpointer data)
+{
+  PowerMonitor *monitor = data;
+  gboolean suspending;
+
+  if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(b)")))
+    return;
+
+  g_variant_get(parameters, "(b)", &suspending);
+  monitor->func(suspending, monitor->user_data);
+
+  if (suspending)
+    power_monitor_uninhibit(monitor);
+  else
+    power_monitor_inhibit(monitor);
+}
+
+static void
+bus_ready(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+  PowerMonitor *monitor;
+  GDBusConnection *connection;
+  GError *error = NULL;
+
+  // Monitor is already freed if connecting has been cancelled
+  connection = g_bus_get_finish(result, &error);
+  if (connection == NULL)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_message("Failed to connect to system bus: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  monitor = data;
+  monitor->connection = connection;
+  monitor->subscription_id =
+    g_dbus_connection_signal_subscribe(connection, LOGIND_NAME, LOGIND_MANAGER_INTERFACE,
+                                       "PrepareForSleep", LOGIND_PATH, NULL,
+                                       G_DBUS_SIGNAL_FLAGS_NONE, prepare_for_sleep,
+                                       monitor, NULL);
+  power_monitor_inhibit(monitor);
+}
+
+
+// External interface
+PowerMonitor*
+power_monitor_new(PowerMonitorFunc func, gpointer user_data)
+{
+  PowerMonitor *monitor;
+
+  g_return_val_if_fail(func != NULL, NULL);
+
+  monitor = g_slice_new0(PowerMonitor);
+  monitor->inhibitor = NO_INHIBITOR;
+  monitor->cancellable = g_cancellable_new();
+  monitor->func = func;
+  monitor->user_data = user_data;
+
+  g_bus_get(G_BUS_TYPE_SYSTEM, monitor->cancellable, bus_ready, monitor);
+
+  return monitor;
+}
+
+void
+power_monitor_free(PowerMonitor *monitor)
+{
+  if (monitor == NULL)
+    return;
+
+  g_cancellable_cancel(monitor->cancellable);
+  g_object_unref(monitor->cancellable);
+
+  if (monitor->connection)
+  {
+    g_dbus_connection_signal_unsubscribe(monitor->connection, monitor->subscription_id);
+    g_object_unref(monitor->connection);
+  }
+  power_monitor_uninhibit(monitor);
+
+  g_slice_free(PowerMonitor, monitor);
+}
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "profiler.h"
+
+typedef struct
+{
+  guint depth; // Only outermost of nested runs is timed
+  gint64 entered_at;
+  guint64 calls_at_enter;
+
+  guint count;
+  gint64 total_time;
+  gint64 max_time;
+  guint64 calls;
+} Section;
+
+/* Accounting of settings paths: wall time of every section run and number of
+ * D-Bus round trips to xfconf daemon made within it. Cost is two monotonic
+ * clock reads per run. Nothing is reported here - counters are read by
+ * benchmarks. */
+struct _Profiler
+{
+  Section sections[PROFILER_SECTION_COUNT];
+  guint64 calls; // D-Bus round trips in total
+};
+
+
+// External interface
+Profiler*
+profiler_new(void)
+{
+  return g_slice_new0(Profiler);
+}
+
+void
+profiler_free(Profiler *profiler)
+{
+  if (profiler == NULL)
+    return;
+
+  g_slice_free(Profiler, profiler);
+}
+
+void
+profiler_enter(Profiler *profiler, ProfilerSection section)
+{
+  Section *s;
+
+  g_return_if_fail(profiler != NULL);
+  g_return_if_fail(section < PROFILER_SECTION_COUNT);
+
+  s = &profiler->sections[section];
+  if (s->depth++)
+    return;
+
+  s->entered_at = g_get_monotonic_time();
+  s->calls_at_enter = profiler->calls;
+}
+
+void
+profiler_leave(Profiler *profiler, ProfilerSection section)
+{
+  Section *s;
+  gint64 time;
+  guint64 calls;
+
+  g_return_if_fail(profiler != NULL);
+  g_return_if_fail(section < PROFILER_SECTION_COUNT);
+
+  s = &profiler->sections[section];
+  g_return_if_fail(s->depth > 0);
+  if (--s->depth)
+    return;
+
+  time = g_get_monotonic_time() - s->entered_at;
+  calls = profiler->calls - s->calls_at_enter;
+  s->count++;
+  s->total_time += time;
+  s->max_time = MAX(s->max_time, time);
+  s->calls += calls;
+}
+
+// Records D-Bus round trips to xfconf daemon, attributed to sections entered
+void
+profiler_count_calls(Profiler *profiler, guint calls)
+{
+  g_return_if_fail(profiler != NULL);
+
+  profiler->calls += calls;
+}
+
+// Times are in microseconds; any of output arguments may be NULL
+void
+profiler_get_section(Profiler *profiler, ProfilerSection section, guint *count,
+                     gint64 *total_time, gint64 *max_time, guint64 *calls)
+{
+  Section *s;
+
+  g_return_if_fail(profiler != NULL);
+  g_return_if_fail(section < PROFILER_SECTION_COUNT);
+
+  s = &profiler->sections[section];
+  if (count)
+    *count = s->count;
+  if (total_time)
+    *total_time = s->total_time;
+  if (max_time)
+    *max_time = s->max_time;
+  if (calls)
+    *calls = s->calls;
+}
+
+guint64
+profiler_get_calls(Profiler *profiler)
+{
+  g_return_val_if_fail(profiler != NULL, 0);
+
+  return profiler->calls;
+}
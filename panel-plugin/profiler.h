@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __ALARM_PLUGIN_PROFILER_H__
+#define __ALARM_PLUGIN_PROFILER_H__
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  PROFILER_LOAD_SETTINGS,
+  PROFILER_SAVE_SETTINGS,
+  PROFILER_RESET_SETTINGS,
+  PROFILER_FLUSH_SETTINGS,
+  PROFILER_MOVE_ALARM,
+  PROFILER_SECTION_COUNT
+} ProfilerSection;
+
+typedef struct _Profiler Profiler;
+
+Profiler* profiler_new(void);
+void profiler_free(Profiler *profiler);
+
+void profiler_enter(Profiler *profiler, ProfilerSection section);
+void profiler_leave(Profiler *profiler, ProfilerSection section);
+void profiler_count_calls(Profiler *profiler, guint calls);
+
+void profiler_get_section(Profiler *profiler, ProfilerSection section, guint *count,
+                          gint64 *total_time, gint64 *max_time, guint64 *calls);
+guint64 profiler_get_calls(Profiler *profiler);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_PROFILER_H__ */
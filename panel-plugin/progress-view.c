@@ -0,0 +1,498 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+#include "alarm-store.h"
+#include "progress-view.h"
+
+// Minimum thickness of single bar and gap between bars, in pixels
+#define PROGRESS_BAR_SIZE 6
+#define PROGRESS_BAR_SPACING 1
+#define PROGRESS_TROUGH_ALPHA 0.25
+
+/* Progress of all running alarms drawn side by side in single widget, in
+ * order of AlarmContext.alarms. Every bar remembers its filled length in
+ * pixels and is woken by plugin scheduler only when its fill reaches the next
+ * pixel, given current bar size. Then only the changed part of bar is
+ * invalidated. This way long running alarm on small panel costs one wakeup
+ * per pixel instead of one per second. Colors are parsed once and kept per
+ * bar. */
+struct _ProgressView
+{
+  GtkDrawingArea parent;
+
+  AlarmContext *context;
+  GtkOrientation orientation; // Of bars, perpendicular to panel
+  GHashTable *bars; // Alarm* => ProgressBar*, for all alarms
+  GPtrArray *running; // ProgressBar* of running alarms, in list order
+  GdkRGBA default_color; // For alarms without color, taken from theme
+  GdkRGBA trough_color;
+  guint layout_id; // Idle source rebuilding running bars
+};
+
+typedef struct
+{
+  ProgressView *view;
+  Alarm *alarm;
+  gulong notify_id;
+  GdkRGBA color;
+  gboolean has_color;
+  gboolean running;
+  GdkRectangle area; // Whole bar (trough), valid for running bars
+  gint length; // Filled pixels, as last drawn
+} ProgressBar;
+
+
+// Utilities
+static void
+progress_bar_free(ProgressBar *bar)
+{
+  scheduler_remove(bar->view->context->scheduler, bar);
+  g_signal_handler_disconnect(bar->alarm, bar->notify_id);
+  g_slice_free(ProgressBar, bar);
+}
+
+static void
+progress_bar_update_color(ProgressBar *bar)
+{
+  bar->has_color = bar->alarm->color != NULL;
+  if (bar->has_color)
+    bar->color = *bar->alarm->color;
+}
+
+static gint
+progress_bar_size(ProgressBar *bar)
+{
+  return bar->view->orientation == GTK_ORIENTATION_VERTICAL ?
+    bar->area.height : bar->area.width;
+}
+
+static gint
+progress_bar_length(ProgressBar *bar, GDateTime *now)
+{
+  return (gint) (alarm_progress(bar->alarm, now) * progress_bar_size(bar) + 0.5);
+}
+
+// Part of bar between fill lengths from and to; vertical bars fill from the bottom
+static void
+progress_bar_strip(ProgressBar *bar, gint from, gint to, GdkRectangle *strip)
+{
+  *strip = bar->area;
+  if (bar->view->orientation == GTK_ORIENTATION_VERTICAL)
+  {
+    strip->y += strip->height - to;
+    strip->height = to - from;
+  }
+  else
+  {
+    strip->x += from;
+    strip->width = to - from;
+  }
+}
+
+static void progress_bar_due(gpointer key, gpointer user_data);
+
+/* Wakes bar when its rounded length grows by a pixel, i.e. when progress
+ * passes the middle of the next pixel. Full bar waits for alarm deadline, from
+ * where recurring alarm starts its next interval. */
+static void
+progress_bar_schedule(ProgressBar *bar, GDateTime *now)
+{
+  Alarm *alarm = bar->alarm;
+  GTimeSpan total, wait;
+  gint size = progress_bar_size(bar);
+
+  if (alarm->period_start == NULL || alarm->deadline == NULL || size <= 0)
+  {
+    scheduler_remove(bar->view->context->scheduler, bar);
+    return;
+  }
+
+  total = g_date_time_difference(alarm->deadline, alarm->period_start);
+  if (bar->length < size && total > 0)
+    wait = total * (2 * bar->length + 1) / (2 * size) -
+      g_date_time_difference(now, alarm->period_start) + 1;
+  else
+    wait = g_date_time_difference(alarm->deadline, now);
+
+  scheduler_add(bar->view->context->scheduler, bar,
+                scheduler_get_time(bar->view->context->scheduler) + MAX(wait, 0),
+                progress_bar_due, NULL);
+}
+
+/* Splits allocation evenly between running bars and recomputes their
+ * lengths. Caller is responsible for redrawing. */
+static void
+progress_view_allocate_bars(ProgressView *view)
+{
+  GtkAllocation allocation;
+  ProgressBar *bar;
+  GDateTime *now;
+  gint across, start, end;
+  guint count = view->running->len;
+
+  gtk_widget_get_allocation(GTK_WIDGET(view), &allocation);
+  across = view->orientation == GTK_ORIENTATION_VERTICAL ?
+    allocation.width : allocation.height;
+
+  now = clock_get_now(view->context->clock);
+  for (guint i = 0; i < count; i++)
+  {
+    bar = g_ptr_array_index(view->running, i);
+
+    start = across * i / count;
+    end = across * (i + 1) / count - (i + 1 < count ? PROGRESS_BAR_SPACING : 0);
+    if (view->orientation == GTK_ORIENTATION_VERTICAL)
+    {
+      bar->area.x = start;
+      bar->area.y = 0;
+      bar->area.width = MAX(end - start, 1);
+      bar->area.height = allocation.height;
+    }
+    else
+    {
+      bar->area.x = 0;
+      bar->area.y = start;
+      bar->area.width = allocation.width;
+      bar->area.height = MAX(end - start, 1);
+    }
+    bar->length = progress_bar_length(bar, now);
+    progress_bar_schedule(bar, now);
+  }
+  g_date_time_unref(now);
+}
+
+
+static void
+progress_view_update_size_request(ProgressView *view)
+{
+  gint size = MAX(view->running->len, 1) * (PROGRESS_BAR_SIZE + PROGRESS_BAR_SPACING) -
+    PROGRESS_BAR_SPACING;
+
+  if (view->orientation == GTK_ORIENTATION_VERTICAL)
+    gtk_widget_set_size_request(GTK_WIDGET(view), size, -1);
+  else
+    gtk_widget_set_size_request(GTK_WIDGET(view), -1, size);
+}
+
+static gboolean
+progress_view_layout(gpointer data)
+{
+  ProgressView *view = ALARM_PLUGIN_PROGRESS_VIEW(data);
+  ProgressBar *bar;
+  Alarm *alarm;
+  guint count = view->running->len;
+
+  view->layout_id = 0;
+
+  for (guint i = 0; i < count; i++)
+  {
+    bar = g_ptr_array_index(view->running, i);
+    bar->running = FALSE;
+    scheduler_remove(view->context->scheduler, bar);
+  }
+  g_ptr_array_set_size(view->running, 0);
+
+  for (guint i = 0; i < view->context->alarms->len; i++)
+  {
+    alarm = g_ptr_array_index(view->context->alarms, i);
+    bar = g_hash_table_lookup(view->bars, alarm);
+    if (bar && alarm->started_at && alarm->deadline)
+    {
+      bar->running = TRUE;
+      g_ptr_array_add(view->running, bar);
+    }
+  }
+
+  progress_view_update_size_request(view);
+  progress_view_allocate_bars(view);
+  gtk_widget_queue_draw(GTK_WIDGET(view));
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Alarm notifies deadline whenever it is started, stopped, rescheduled or
+ * moves on to next occurrence. Running bars are collected once changes settle. */
+static void
+progress_view_queue_layout(ProgressView *view)
+{
+  if (view->layout_id == 0)
+    view->layout_id = g_idle_add(progress_view_layout, view);
+}
+
+static void alarm_notify(Alarm *alarm, GParamSpec *pspec, ProgressBar *bar);
+
+static void
+progress_view_add(ProgressView *view, Alarm *alarm)
+{
+  ProgressBar *bar;
+
+  if (g_hash_table_contains(view->bars, alarm))
+    return;
+
+  bar = g_slice_new0(ProgressBar);
+  bar->view = view;
+  bar->alarm = alarm;
+  bar->notify_id = g_signal_connect(alarm, "notify", G_CALLBACK(alarm_notify), bar);
+  progress_bar_update_color(bar);
+  g_hash_table_insert(view->bars, alarm, bar);
+
+  progress_view_queue_layout(view);
+}
+
+static void
+progress_view_remove(ProgressView *view, Alarm *alarm)
+{
+  ProgressBar *bar;
+
+  bar = g_hash_table_lookup(view->bars, alarm);
+  if (bar == NULL)
+    return;
+
+  // Bar is dropped from running bars right away, as it is freed below
+  if (bar->running)
+    g_ptr_array_remove(view->running, bar);
+  g_hash_table_remove(view->bars, alarm);
+
+  progress_view_queue_layout(view);
+}
+
+
+// Callbacks
+static void
+progress_bar_due(gpointer key, gpointer user_data)
+{
+  ProgressBar *bar = key;
+  GdkRectangle dirty;
+  GDateTime *now;
+  gint length;
+
+  now = clock_get_now(bar->view->context->clock);
+  length = progress_bar_length(bar, now);
+  if (length != bar->length)
+  {
+    // Only the strip between old and new end of fill changes
+    progress_bar_strip(bar, MIN(length, bar->length), MAX(length, bar->length), &dirty);
+    bar->length = length;
+    gtk_widget_queue_draw_area(GTK_WIDGET(bar->view), dirty.x, dirty.y,
+                               dirty.width, dirty.height);
+  }
+
+  progress_bar_schedule(bar, now);
+  g_date_time_unref(now);
+}
+
+static void
+alarm_notify(Alarm *alarm, GParamSpec *pspec, ProgressBar *bar)
+{
+  ProgressView *view = bar->view;
+
+  if (pspec->name == g_intern_static_string("color"))
+  {
+    progress_bar_update_color(bar);
+    if (bar->running)
+      gtk_widget_queue_draw_area(GTK_WIDGET(view), bar->area.x, bar->area.y,
+                                 bar->area.width, bar->area.height);
+  }
+  else if (pspec->name == g_intern_static_string("deadline"))
+    progress_view_queue_layout(view);
+}
+
+static void
+store_row_inserted(GtkTreeModel *store, GtkTreePath *path, GtkTreeIter *iter,
+                   ProgressView *view)
+{
+  Alarm *alarm;
+
+  gtk_tree_model_get(store, iter, AM_COL_DATA, &alarm, -1);
+  progress_view_add(view, alarm);
+}
+
+// Deleted alarm is no longer in the list, while its bar still is
+static void
+store_row_deleted(GtkTreeModel *store, GtkTreePath *path, ProgressView *view)
+{
+  GHashTableIter ht_iter;
+  Alarm *alarm;
+
+  g_hash_table_iter_init(&ht_iter, view->bars);
+  while (g_hash_table_iter_next(&ht_iter, (gpointer) &alarm, NULL))
+    if (alarm_list_get(view->context, alarm->position) != alarm)
+    {
+      progress_view_remove(view, alarm);
+      return;
+    }
+}
+
+static void
+store_rows_reordered(GtkTreeModel *store, GtkTreePath *path, GtkTreeIter *iter,
+                     gpointer new_order, ProgressView *view)
+{
+  progress_view_queue_layout(view);
+}
+
+
+// GObject definition
+G_DEFINE_TYPE(ProgressView, progress_view, GTK_TYPE_DRAWING_AREA)
+
+static gboolean
+progress_view_draw(GtkWidget *widget, cairo_t *cr)
+{
+  ProgressView *view = ALARM_PLUGIN_PROGRESS_VIEW(widget);
+  ProgressBar *bar;
+  GdkRectangle clip, fill;
+
+  if (!gdk_cairo_get_clip_rectangle(cr, &clip))
+    return FALSE;
+
+  for (guint i = 0; i < view->running->len; i++)
+  {
+    bar = g_ptr_array_index(view->running, i);
+    if (!gdk_rectangle_intersect(&bar->area, &clip, NULL))
+      continue;
+
+    gdk_cairo_set_source_rgba(cr, &view->trough_color);
+    gdk_cairo_rectangle(cr, &bar->area);
+    cairo_fill(cr);
+
+    progress_bar_strip(bar, 0, bar->length, &fill);
+    gdk_cairo_set_source_rgba(cr, bar->has_color ? &bar->color : &view->default_color);
+    gdk_cairo_rectangle(cr, &fill);
+    cairo_fill(cr);
+  }
+
+  return FALSE;
+}
+
+static void
+progress_view_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
+{
+  GTK_WIDGET_CLASS(progress_view_parent_class)->size_allocate(widget, allocation);
+
+  progress_view_allocate_bars(ALARM_PLUGIN_PROGRESS_VIEW(widget));
+}
+
+static void
+progress_view_style_updated(GtkWidget *widget)
+{
+  ProgressView *view = ALARM_PLUGIN_PROGRESS_VIEW(widget);
+  GtkStyleContext *context;
+
+  GTK_WIDGET_CLASS(progress_view_parent_class)->style_updated(widget);
+
+  context = gtk_widget_get_style_context(widget);
+  gtk_style_context_get_color(context, gtk_style_context_get_state(context),
+                              &view->default_color);
+  view->trough_color = view->default_color;
+  view->trough_color.alpha *= PROGRESS_TROUGH_ALPHA;
+
+  gtk_widget_queue_draw(widget);
+}
+
+static void
+progress_view_finalize(GObject *object)
+{
+  ProgressView *view = ALARM_PLUGIN_PROGRESS_VIEW(object);
+
+  if (view->layout_id)
+    g_source_remove(view->layout_id);
+  g_ptr_array_free(view->running, TRUE);
+  g_hash_table_destroy(view->bars);
+
+  G_OBJECT_CLASS(progress_view_parent_class)->finalize(object);
+}
+
+static void
+progress_view_class_init(ProgressViewClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+
+  gobject_class->finalize = progress_view_finalize;
+
+  widget_class->draw = progress_view_draw;
+  widget_class->size_allocate = progress_view_size_allocate;
+  widget_class->style_updated = progress_view_style_updated;
+}
+
+static void
+progress_view_init(ProgressView *view)
+{
+  view->orientation = GTK_ORIENTATION_VERTICAL;
+  view->bars = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify) progress_bar_free);
+  view->running = g_ptr_array_new();
+  view->layout_id = 0;
+
+  progress_view_update_size_request(view);
+}
+
+
+// External interface
+/* View follows alarms added, removed and reordered through store, which
+ * has to outlive it. */
+GtkWidget*
+progress_view_new(AlarmContext *context, AlarmStore *store)
+{
+  ProgressView *view;
+
+  g_return_val_if_fail(context != NULL, NULL);
+  g_return_val_if_fail(ALARM_PLUGIN_IS_ALARM_STORE(store), NULL);
+
+  view = g_object_new(ALARM_PLUGIN_TYPE_PROGRESS_VIEW, NULL);
+  view->context = context;
+  for (guint i = 0; i < context->alarms->len; i++)
+    progress_view_add(view, g_ptr_array_index(context->alarms, i));
+
+  g_signal_connect_object(store, "row-inserted", G_CALLBACK(store_row_inserted), view, 0);
+  g_signal_connect_object(store, "row-deleted", G_CALLBACK(store_row_deleted), view, 0);
+  g_signal_connect_object(store, "rows-reordered", G_CALLBACK(store_rows_reordered), view, 0);
+
+  return GTK_WIDGET(view);
+}
+
+// Bars are perpendicular to panel
+void
+progress_view_set_orientation(ProgressView *view, GtkOrientation panel_orientation)
+{
+  g_return_if_fail(ALARM_PLUGIN_IS_PROGRESS_VIEW(view));
+
+  view->orientation = panel_orientation == GTK_ORIENTATION_HORIZONTAL ?
+    GTK_ORIENTATION_VERTICAL : GTK_ORIENTATION_HORIZONTAL;
+  progress_view_update_size_request(view);
+  gtk_widget_queue_resize(GTK_WIDGET(view));
+}
+
+// Rebuilds bars after alarms are reordered or time jumped (resume from suspend)
+void
+progress_view_refresh(ProgressView *view)
+{
+  g_return_if_fail(ALARM_PLUGIN_IS_PROGRESS_VIEW(view));
+
+  progress_view_queue_layout(view);
+}
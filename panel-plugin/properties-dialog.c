@@ -23,64 +23,20 @@
 #include <libxfce4panel/xfce-panel-plugin.h>
 #include <xfconf/xfconf.h>
 
-#include "common.h"
+#include "common-ui.h"
 #include "alert.h"
+#include "rerun.h"
+#include "alarm-context.h"
 #include "alarm-plugin.h"
 #include "alarm.h"
+#include "alarm-store.h"
 #include "properties-dialog.h"
 #include "properties-dialog_ui.h"
 #include "alarm-dialog.h"
 #include "alert-box.h"
 
-#define UNICODE_BLOCK "\xe2\x96\x8a"
-
-// Column numbers are used in .glade - update if changed
-enum AlarmColumns
-{
-  AM_COL_DATA,
-  AM_COL_ICON_NAME,
-  AM_COL_TIME,
-  AM_COL_COLOR,
-  AM_COL_NAME,
-  AM_COL_COUNT
-};
-
 
 // Utilities
-static void
-alarm_to_tree_iter(Alarm *alarm, GtkListStore *store, GtkTreeIter *iter)
-{
-  gchar *time, *color = NULL;
-
-  g_return_if_fail(alarm != NULL);
-  g_return_if_fail(GTK_IS_LIST_STORE(store));
-  g_return_if_fail(iter != NULL);
-
-  time = g_strdup_printf("<span size=\"large\" weight=\"normal\">%02u:%02u</span>" \
-                         "<span size=\"small\" weight=\"normal\">:%02u</span>",
-                         alarm->time/3600, alarm->time%3600/60, alarm->time%60);
-  /* Setting color through markup preserves proper color on item selection (as
-   * opposed to setting it through cell renderer background property). */
-  if (alarm->color)
-    // NOTE: send PR with proper double->int conversion to gdk_rgba_to_string
-    color = g_strdup_printf("<span size=\"x-large\" foreground=\"#%02x%02x%02x\">"
-                            UNICODE_BLOCK "</span>",
-                            CLAMP((gint) alarm->color->red*256, 0, 255),
-                            CLAMP((gint) alarm->color->green*256, 0, 255),
-                            CLAMP((gint) alarm->color->blue*256, 0, 255));
-
-  gtk_list_store_set(store, iter,
-                     AM_COL_DATA, alarm,
-                     AM_COL_ICON_NAME, alarm_type_icons[alarm->type],
-                     AM_COL_TIME, time,
-                     AM_COL_COLOR, color,
-                     AM_COL_NAME, alarm->name,
-                     -1);
-
-  g_free(time);
-  g_free(color);
-}
-
 static Alarm*
 get_selected_alarm(GtkBuilder *builder, GtkTreeModel **model, GtkTreeIter *iter)
 {
@@ -100,21 +56,20 @@ new_alarm(AlarmPlugin *plugin, GtkWidget *dialog)
 {
   Alarm *alarm = NULL;
   GtkBuilder *builder;
-  GObject *store;
-  GtkTreeIter tree_iter;
+  GObject *view;
 
   show_alarm_dialog(dialog, XFCE_PANEL_PLUGIN(plugin), &alarm);
-  if (alarm)
-    plugin->alarms = g_list_append(plugin->alarms, alarm);
-  else
+  if (alarm == NULL)
     return;
-  save_alarm_settings(plugin, alarm);
 
   builder = g_object_get_data(G_OBJECT(dialog), "builder");
-  store = gtk_builder_get_object(builder, "alarm-store");
-  g_return_if_fail(GTK_IS_LIST_STORE(store));
-  gtk_list_store_append(GTK_LIST_STORE(store), &tree_iter);
-  alarm_to_tree_iter(alarm, GTK_LIST_STORE(store), &tree_iter);
+  view = gtk_builder_get_object(builder, "alarm-view");
+  g_return_if_fail(GTK_IS_TREE_VIEW(view));
+  alarm_store_append(ALARM_PLUGIN_ALARM_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(view))),
+                     alarm);
+
+  save_alarm_settings(plugin->context, alarm);
+  bind_alarm_settings(plugin->context, alarm);
 }
 
 static void
@@ -130,10 +85,11 @@ edit_alarm(AlarmPlugin *plugin, GtkWidget *dialog)
   alarm = get_selected_alarm(builder, &store, &tree_iter);
   if (alarm == NULL)
     return;
+  bind_alarm_settings(plugin->context, alarm);
   show_alarm_dialog(dialog, XFCE_PANEL_PLUGIN(plugin), &alarm);
-  save_alarm_settings(plugin, alarm);
-
-  alarm_to_tree_iter(alarm, GTK_LIST_STORE(store), &tree_iter);
+  save_alarm_settings(plugin->context, alarm);
+  schedule_alarm(plugin->context, alarm);
+  // Row is updated by store on alarm property notifications
 }
 
 static void
@@ -141,7 +97,6 @@ remove_alarm(AlarmPlugin *plugin, GtkWidget *dialog)
 {
   GtkBuilder *builder;
   Alarm *alarm;
-  GList *alarm_iter, *next_iter;
   GtkTreeModel *store;
   GtkTreeIter tree_iter;
 
@@ -150,14 +105,11 @@ remove_alarm(AlarmPlugin *plugin, GtkWidget *dialog)
   if (alarm == NULL)
     return;
 
-  gtk_list_store_remove(GTK_LIST_STORE(store), &tree_iter);
+  alarm_store_remove(ALARM_PLUGIN_ALARM_STORE(store), alarm);
 
-  reset_alarm_settings(plugin, alarm);
-
-  alarm_iter = g_list_find(plugin->alarms, alarm);
-  next_iter = alarm_iter->next;
-  plugin->alarms = g_list_remove_link(plugin->alarms, alarm_iter);
-  save_alarm_positions(plugin, next_iter, NULL);
+  acknowledge_alarm(plugin->context, alarm);
+  stop_alarm(plugin->context, alarm);
+  reset_alarm_settings(plugin->context, alarm);
 
   g_object_unref(alarm);
 }
@@ -234,48 +186,11 @@ alarm_selection_changed(GtkTreeSelection *selection, GtkWidget *dialog)
   set_sensitive(builder, selected, "edit", "remove", NULL);
 }
 
-static void
-alarm_store_row_changed(GtkTreeModel *store, GtkTreePath *path, GtkTreeIter *iter,
-                        AlarmPlugin *plugin)
-{
-  Alarm *alarm = NULL;
-  gint list_position;
-  gint store_position;
-  GList *iter_from, *iter_to;
-
-  g_return_if_fail(GTK_IS_LIST_STORE(store));
-  g_return_if_fail(XFCE_IS_ALARM_PLUGIN(plugin));
-  // "row-changed" signal is emitted before DND source is removed from GtkListStore
-  g_return_if_fail((gtk_tree_model_iter_n_children(store, NULL) - 1) ==
-                   (gint) g_list_length(plugin->alarms));
-
-  /* After DND reordering of store item, positions of some Alarms on plugin->alarms
-   * list will be different than positions in store. plugin->alarms has to be reordered
-   * accordingly and updated positions saved. */
-  gtk_tree_model_get(store, iter, AM_COL_DATA, &alarm, -1);
-  g_return_if_fail(alarm != NULL);
-  list_position = g_list_index(plugin->alarms, alarm);
-  g_return_if_fail(list_position != -1);
-  store_position = gtk_tree_path_get_indices(path)[0];
-  // Correct store_position for the not-yet-removed DND source if required
-  if (list_position < store_position)
-    store_position--;
-
-  if (list_position == store_position)
-    return;
-
-  plugin->alarms = g_list_remove(plugin->alarms, alarm);
-  iter_to = g_list_nth(plugin->alarms, MAX(list_position, store_position));
-  plugin->alarms = g_list_insert(plugin->alarms, alarm, store_position);
-  iter_from = g_list_nth(plugin->alarms, MIN(list_position, store_position));
-  save_alarm_positions(plugin, iter_from, iter_to);
-}
-
 static void
 alarm_store_row_inserted(GtkTreeModel *store, GtkTreePath *path, GtkTreeIter *iter,
                          GtkWidget *view)
 {
-  g_return_if_fail(GTK_IS_LIST_STORE(store));
+  g_return_if_fail(ALARM_PLUGIN_IS_ALARM_STORE(store));
   g_return_if_fail(GTK_IS_TREE_VIEW(view));
 
   gtk_tree_view_set_cursor(GTK_TREE_VIEW(view), path, NULL, FALSE);
@@ -291,8 +206,7 @@ show_properties_dialog(XfcePanelPlugin *panel_plugin)
   AlarmPlugin *plugin = XFCE_ALARM_PLUGIN(panel_plugin);
   GtkBuilder *builder;
   GObject *dialog, *object;
-  GList *alarm_iter;
-  GtkTreeIter tree_iter;
+  AlarmStore *store;
 
   builder = alarm_builder_new(panel_plugin, "properties-dialog", &dialog,
                               properties_dialog_ui, properties_dialog_ui_length,
@@ -300,9 +214,10 @@ show_properties_dialog(XfcePanelPlugin *panel_plugin)
   g_return_if_fail(GTK_IS_BUILDER(builder));
   g_return_if_fail(GTK_IS_DIALOG(dialog));
 
+  bind_alert_settings(plugin->context);
   object = gtk_builder_get_object(builder, "alert-frame");
   g_return_if_fail(GTK_IS_CONTAINER(object));
-  g_return_if_fail(show_alert_box(plugin->alert, panel_plugin, GTK_CONTAINER(object)));
+  g_return_if_fail(show_alert_box(plugin->context->alert, panel_plugin, GTK_CONTAINER(object)));
 
   xfce_panel_plugin_take_window(panel_plugin, GTK_WINDOW(dialog));
 
@@ -310,15 +225,14 @@ show_properties_dialog(XfcePanelPlugin *panel_plugin)
   g_object_weak_ref(dialog, (GWeakNotify) G_CALLBACK(xfce_panel_plugin_unblock_menu),
                     panel_plugin);
 
-  object = gtk_builder_get_object(builder, "alarm-store");
-  g_return_if_fail(GTK_IS_LIST_STORE(object));
-  alarm_iter = plugin->alarms;
-  while (alarm_iter)
-  {
-    gtk_list_store_append(GTK_LIST_STORE(object), &tree_iter);
-    alarm_to_tree_iter(alarm_iter->data, GTK_LIST_STORE(object), &tree_iter);
-    alarm_iter = alarm_iter->next;
-  }
+  /* Store is backed by context alarms and lives as long as plugin, rows are
+   * formatted only when displayed */
+  object = gtk_builder_get_object(builder, "alarm-view");
+  g_return_if_fail(GTK_IS_TREE_VIEW(object));
+  store = plugin->store;
+  g_signal_connect_object(store, "row-inserted", G_CALLBACK(alarm_store_row_inserted),
+                          object, 0);
+  gtk_tree_view_set_model(GTK_TREE_VIEW(object), GTK_TREE_MODEL(store));
 
   gtk_builder_add_callback_symbols(builder,
       "new_button_clicked", G_CALLBACK(new_button_clicked),
@@ -327,8 +241,6 @@ show_properties_dialog(XfcePanelPlugin *panel_plugin)
       "alarm_view_button_press", G_CALLBACK(alarm_view_button_press),
       "alarm_view_row_activated", G_CALLBACK(alarm_view_row_activated),
       "alarm_selection_changed", G_CALLBACK(alarm_selection_changed),
-      "alarm_store_row_changed", G_CALLBACK(alarm_store_row_changed),
-      "alarm_store_row_inserted", G_CALLBACK(alarm_store_row_inserted),
       NULL);
   gtk_builder_connect_signals(builder, plugin);
 
@@ -0,0 +1,174 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "rerun.h"
+#include "recurrence.h"
+
+/* Occurrences are computed in closed form, without iterating over candidate
+ * days. All calendar arithmetic is done on local dates (GDate), and only final
+ * occurrence is converted to GDateTime, so DST changes do not shift time of day. */
+
+// Utilities
+static void
+date_from_date_time(GDate *date, GDateTime *date_time)
+{
+  g_date_clear(date, 1);
+  g_date_set_dmy(date, g_date_time_get_day_of_month(date_time),
+                 g_date_time_get_month(date_time), g_date_time_get_year(date_time));
+}
+
+static GDateTime*
+occurrence_on(GDate *date, guint time)
+{
+  return g_date_time_new_local(g_date_get_year(date), g_date_get_month(date),
+                               g_date_get_day(date),
+                               time/3600, time%3600/60, time%60);
+}
+
+// Day of the first occurrence of time of day strictly after given moment
+static void
+first_occurrence(guint time, GDateTime *after, GDate *date)
+{
+  GDateTime *local, *occurrence;
+
+  local = g_date_time_to_local(after);
+  date_from_date_time(date, local);
+  occurrence = occurrence_on(date, time);
+  if (g_date_time_compare(occurrence, local) <= 0)
+    g_date_add_days(date, 1);
+  g_date_time_unref(occurrence);
+  g_date_time_unref(local);
+}
+
+// Date N*k months after first, with day of month clamped to month length
+static void
+nth_month(GDate *first, guint months, GDate *date)
+{
+  guint month_index;
+  GDateYear year;
+  GDateMonth month;
+
+  month_index = g_date_get_year(first)*12 + (g_date_get_month(first) - 1) + months;
+  year = month_index / 12;
+  month = month_index % 12 + 1;
+
+  g_date_clear(date, 1);
+  g_date_set_dmy(date, MIN(g_date_get_day(first), g_date_get_days_in_month(month, year)),
+                 month, year);
+}
+
+
+// External interface
+/* Returns the first occurrence of clock alarm strictly after 'after'.
+ * 'anchor' is the moment alarm was started - reruns every N days/weeks/months
+ * are counted from its first occurrence. */
+GDateTime*
+recurrence_next(guint time, gint rerun_every, RerunMode rerun_mode,
+                GDateTime *anchor, GDateTime *after)
+{
+  GDate date, first, candidate;
+  guint weekday, rotated, period, multiplier, elapsed, months;
+
+  g_return_val_if_fail(anchor != NULL, NULL);
+  g_return_val_if_fail(after != NULL, NULL);
+
+  // Earliest day on which alarm can fire, ignoring reruns
+  first_occurrence(time, after, &date);
+
+  if (rerun_every > RERUN_DOW)
+  {
+    /* Rotate day-of-week mask, so bit 0 corresponds to earliest candidate day.
+     * Lowest set bit is then the offset (in days) to the next matching day. */
+    weekday = g_date_get_weekday(&date) - G_DATE_MONDAY;
+    rotated = ((rerun_every >> weekday) | (rerun_every << (7 - weekday))) & RERUN_EVERYDAY;
+    g_date_add_days(&date, g_bit_nth_lsf(rotated, -1));
+  }
+  else if (rerun_every < RERUN_DOW)
+  {
+    multiplier = -rerun_every;
+    first_occurrence(time, anchor, &first);
+
+    if (g_date_compare(&date, &first) <= 0)
+      date = first;
+    else if (rerun_mode == RERUN_NMONTHS)
+    {
+      months = (g_date_get_year(&date)*12 + g_date_get_month(&date)) -
+               (g_date_get_year(&first)*12 + g_date_get_month(&first));
+      nth_month(&first, months - months % multiplier, &candidate);
+      if (g_date_compare(&candidate, &date) < 0)
+        nth_month(&first, months - months % multiplier + multiplier, &candidate);
+      date = candidate;
+    }
+    else
+    {
+      period = (rerun_mode == RERUN_NWEEKS) ? 7*multiplier : multiplier;
+      elapsed = g_date_get_julian(&date) - g_date_get_julian(&first);
+      date = first;
+      g_date_add_days(&date, (elapsed + period - 1) / period * period);
+    }
+  }
+
+  return occurrence_on(&date, time);
+}
+
+/* Returns the last occurrence strictly before 'before' and after 'anchor', or
+ * NULL if there is none. Search starts the longest gap between occurrences
+ * (plus a day for DST) before 'before', so only few occurrences are stepped. */
+GDateTime*
+recurrence_previous(guint time, gint rerun_every, RerunMode rerun_mode,
+                    GDateTime *anchor, GDateTime *before)
+{
+  GDateTime *from, *occurrence, *previous = NULL;
+  gint gap_days;
+
+  g_return_val_if_fail(anchor != NULL, NULL);
+  g_return_val_if_fail(before != NULL, NULL);
+
+  if (rerun_every > RERUN_DOW)
+    gap_days = 7;
+  else if (rerun_every < RERUN_DOW)
+    gap_days = -rerun_every * (rerun_mode == RERUN_NMONTHS ? 31 :
+                               rerun_mode == RERUN_NWEEKS ? 7 : 1);
+  else
+    gap_days = 1;
+
+  from = g_date_time_add_days(before, -gap_days - 1);
+  if (g_date_time_compare(from, anchor) < 0)
+  {
+    g_date_time_unref(from);
+    from = g_date_time_ref(anchor);
+  }
+
+  occurrence = recurrence_next(time, rerun_every, rerun_mode, anchor, from);
+  g_date_time_unref(from);
+  while (g_date_time_compare(occurrence, before) < 0)
+  {
+    g_clear_pointer(&previous, g_date_time_unref);
+    previous = occurrence;
+    occurrence = recurrence_next(time, rerun_every, rerun_mode, anchor, previous);
+  }
+  g_date_time_unref(occurrence);
+
+  return previous;
+}
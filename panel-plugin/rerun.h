@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_RERUN_H__
+#define __ALARM_PLUGIN_RERUN_H__
+
+G_BEGIN_DECLS
+
+enum RerunEvery
+{
+  NO_RERUN        = 0,
+  RERUN_DOW       = 0,
+  RERUN_MONDAY    = 1,
+  RERUN_TUEASDAY  = 1 << 1,
+  RERUN_WEDNESDAY = 1 << 2,
+  RERUN_THURSDAY  = 1 << 3,
+  RERUN_FRIDAY    = 1 << 4,
+  RERUN_SATURDAY  = 1 << 5,
+  RERUN_SUNDAY    = 1 << 6,
+  RERUN_WEEKDAY   = 31,
+  RERUN_WEEKEND   = 96,
+  RERUN_EVERYDAY  = 127
+};
+
+typedef enum
+{
+  RERUN_NDAYS = 0,
+  RERUN_NWEEKS,
+  RERUN_NMONTHS,
+  RERUN_MODE_COUNT
+} RerunMode;
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_RERUN_H__ */
@@ -0,0 +1,397 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "clock.h"
+#include "scheduler.h"
+#include "tracing.h"
+
+// Times of most recent wakeups kept for windowed rate
+#define SCHEDULER_RECENT_WAKEUPS 64
+
+/* All scheduled entries are kept in a binary min-heap ordered by absolute
+ * monotonic deadline (in microseconds, as returned by clock_get_monotonic_time()).
+ * Only one clock timer is armed at any time - for the earliest deadline. */
+typedef struct
+{
+  gpointer key;
+  gint64 deadline;
+  guint index; // Position in Scheduler.heap
+  SchedulerFunc func;
+  gpointer user_data;
+} SchedulerEntry;
+
+struct _Scheduler
+{
+  Clock *clock;
+  GPtrArray *heap;
+  GHashTable *entries; // key => SchedulerEntry*
+
+  guint timer_id;
+  gint64 timer_deadline;
+  gboolean paused; // No timer is armed while paused
+
+  guint64 wakeups;
+  gint64 max_dispatch_time; // Longest wakeup, in real microseconds
+  gint64 recent_wakeups[SCHEDULER_RECENT_WAKEUPS]; // Ring, indexed by wakeups
+};
+
+
+// Utilities
+#define HEAP_ENTRY(heap, i) ((SchedulerEntry*) g_ptr_array_index((heap), (i)))
+
+static void
+heap_swap(GPtrArray *heap, guint i, guint j)
+{
+  gpointer entry = heap->pdata[i];
+
+  heap->pdata[i] = heap->pdata[j];
+  heap->pdata[j] = entry;
+  HEAP_ENTRY(heap, i)->index = i;
+  HEAP_ENTRY(heap, j)->index = j;
+}
+
+static void
+heap_sift_up(GPtrArray *heap, guint i)
+{
+  guint parent;
+
+  while (i > 0)
+  {
+    parent = (i - 1) / 2;
+    if (HEAP_ENTRY(heap, parent)->deadline <= HEAP_ENTRY(heap, i)->deadline)
+      break;
+    heap_swap(heap, i, parent);
+    i = parent;
+  }
+}
+
+static void
+heap_sift_down(GPtrArray *heap, guint i)
+{
+  guint child, smallest;
+
+  while (TRUE)
+  {
+    smallest = i;
+    child = 2*i + 1;
+    if (child < heap->len &&
+        HEAP_ENTRY(heap, child)->deadline < HEAP_ENTRY(heap, smallest)->deadline)
+      smallest = child;
+    child++;
+    if (child < heap->len &&
+        HEAP_ENTRY(heap, child)->deadline < HEAP_ENTRY(heap, smallest)->deadline)
+      smallest = child;
+
+    if (smallest == i)
+      break;
+    heap_swap(heap, i, smallest);
+    i = smallest;
+  }
+}
+
+static void
+heap_remove(GPtrArray *heap, SchedulerEntry *entry)
+{
+  guint i = entry->index, last = heap->len - 1;
+
+  if (i != last)
+  {
+    heap_swap(heap, i, last);
+    g_ptr_array_remove_index(heap, last);
+    heap_sift_down(heap, i);
+    heap_sift_up(heap, i);
+  }
+  else
+    g_ptr_array_remove_index(heap, last);
+}
+
+static void scheduler_dispatch(gpointer data);
+
+static void
+scheduler_arm(Scheduler *scheduler)
+{
+  gint64 deadline;
+
+  deadline = scheduler_next_deadline(scheduler);
+  if (scheduler->timer_id && scheduler->timer_deadline == deadline && !scheduler->paused)
+    return;
+
+  if (scheduler->timer_id)
+    clock_disarm(scheduler->clock, scheduler->timer_id);
+  scheduler->timer_id = CLOCK_NO_TIMER;
+  scheduler->timer_deadline = SCHEDULER_NO_DEADLINE;
+
+  if (deadline == SCHEDULER_NO_DEADLINE || scheduler->paused)
+    return;
+
+  scheduler->timer_id = clock_arm(scheduler->clock, deadline, scheduler_dispatch, scheduler);
+  scheduler->timer_deadline = deadline;
+}
+
+
+// Callbacks
+static void
+scheduler_dispatch(gpointer data)
+{
+  Scheduler *scheduler = data;
+  SchedulerEntry *entry;
+  gint64 now = clock_get_monotonic_time(scheduler->clock);
+  gint64 started_at = g_get_monotonic_time();
+  guint dispatched = 0;
+  gint64 trace_start;
+
+  TRACE_BEGIN(trace_start);
+
+  scheduler->timer_id = CLOCK_NO_TIMER;
+  scheduler->timer_deadline = SCHEDULER_NO_DEADLINE;
+
+  /* Entry is unlinked before its callback is invoked, so callbacks are free to
+   * (re)schedule or remove any key, including their own. */
+  while (scheduler->heap->len && HEAP_ENTRY(scheduler->heap, 0)->deadline <= now)
+  {
+    entry = HEAP_ENTRY(scheduler->heap, 0);
+    heap_remove(scheduler->heap, entry);
+    g_hash_table_steal(scheduler->entries, entry->key);
+
+    entry->func(entry->key, entry->user_data);
+    g_slice_free(SchedulerEntry, entry);
+    dispatched++;
+  }
+
+  scheduler_arm(scheduler);
+
+  scheduler->recent_wakeups[scheduler->wakeups % SCHEDULER_RECENT_WAKEUPS] = now;
+  scheduler->wakeups++;
+  scheduler->max_dispatch_time = MAX(scheduler->max_dispatch_time,
+                                     g_get_monotonic_time() - started_at);
+  TRACE_END(trace_start, "scheduler wakeup", "%u entries dispatched", dispatched);
+}
+
+
+// External interface
+Scheduler*
+scheduler_new(Clock *clock)
+{
+  Scheduler *scheduler;
+
+  g_return_val_if_fail(clock != NULL, NULL);
+
+  scheduler = g_slice_new0(Scheduler);
+  scheduler->clock = clock;
+  scheduler->heap = g_ptr_array_new();
+  scheduler->entries = g_hash_table_new(NULL, NULL);
+  scheduler->timer_deadline = SCHEDULER_NO_DEADLINE;
+
+  return scheduler;
+}
+
+void
+scheduler_free(Scheduler *scheduler)
+{
+  if (scheduler == NULL)
+    return;
+
+  if (scheduler->timer_id)
+    clock_disarm(scheduler->clock, scheduler->timer_id);
+
+  g_hash_table_destroy(scheduler->entries);
+  for (guint i = 0; i < scheduler->heap->len; i++)
+    g_slice_free(SchedulerEntry, HEAP_ENTRY(scheduler->heap, i));
+  g_ptr_array_free(scheduler->heap, TRUE);
+
+  g_slice_free(Scheduler, scheduler);
+}
+
+void
+scheduler_add(Scheduler *scheduler, gpointer key, gint64 deadline,
+              SchedulerFunc func, gpointer user_data)
+{
+  SchedulerEntry *entry;
+
+  g_return_if_fail(scheduler != NULL);
+  g_return_if_fail(func != NULL);
+
+  // Rescheduling existing key only moves its heap entry
+  entry = g_hash_table_lookup(scheduler->entries, key);
+  if (entry == NULL)
+  {
+    entry = g_slice_new(SchedulerEntry);
+    entry->key = key;
+    entry->index = scheduler->heap->len;
+    g_ptr_array_add(scheduler->heap, entry);
+    g_hash_table_insert(scheduler->entries, key, entry);
+  }
+  entry->deadline = deadline;
+  entry->func = func;
+  entry->user_data = user_data;
+
+  heap_sift_down(scheduler->heap, entry->index);
+  heap_sift_up(scheduler->heap, entry->index);
+
+  scheduler_arm(scheduler);
+}
+
+gboolean
+scheduler_remove(Scheduler *scheduler, gpointer key)
+{
+  SchedulerEntry *entry;
+
+  g_return_val_if_fail(scheduler != NULL, FALSE);
+
+  entry = g_hash_table_lookup(scheduler->entries, key);
+  if (entry == NULL)
+    return FALSE;
+
+  heap_remove(scheduler->heap, entry);
+  g_hash_table_remove(scheduler->entries, key);
+  g_slice_free(SchedulerEntry, entry);
+
+  scheduler_arm(scheduler);
+
+  return TRUE;
+}
+
+gboolean
+scheduler_contains(Scheduler *scheduler, gpointer key)
+{
+  g_return_val_if_fail(scheduler != NULL, FALSE);
+
+  return g_hash_table_contains(scheduler->entries, key);
+}
+
+// Test introspection, alarms keep their own deadlines
+gint64
+scheduler_get_deadline(Scheduler *scheduler, gpointer key)
+{
+  SchedulerEntry *entry;
+
+  g_return_val_if_fail(scheduler != NULL, SCHEDULER_NO_DEADLINE);
+
+  entry = g_hash_table_lookup(scheduler->entries, key);
+  return entry ? entry->deadline : SCHEDULER_NO_DEADLINE;
+}
+
+gint64
+scheduler_next_deadline(Scheduler *scheduler)
+{
+  g_return_val_if_fail(scheduler != NULL, SCHEDULER_NO_DEADLINE);
+
+  if (scheduler->heap->len == 0)
+    return SCHEDULER_NO_DEADLINE;
+
+  return HEAP_ENTRY(scheduler->heap, 0)->deadline;
+}
+
+// Test introspection, nothing in the plugin needs the next alarm to expire
+gpointer
+scheduler_next_key(Scheduler *scheduler)
+{
+  g_return_val_if_fail(scheduler != NULL, NULL);
+
+  if (scheduler->heap->len == 0)
+    return NULL;
+
+  return HEAP_ENTRY(scheduler->heap, 0)->key;
+}
+
+// Current time of scheduler's clock, in the same units as deadlines
+gint64
+scheduler_get_time(Scheduler *scheduler)
+{
+  g_return_val_if_fail(scheduler != NULL, 0);
+
+  return clock_get_monotonic_time(scheduler->clock);
+}
+
+// Test introspection
+guint
+scheduler_size(Scheduler *scheduler)
+{
+  g_return_val_if_fail(scheduler != NULL, 0);
+
+  return scheduler->heap->len;
+}
+
+/* Number of wakeups so far and duration of the longest one, including all
+ * callbacks dispatched. Any of output arguments may be NULL. */
+void
+scheduler_get_stats(Scheduler *scheduler, guint64 *wakeups, gint64 *max_dispatch_time)
+{
+  g_return_if_fail(scheduler != NULL);
+
+  if (wakeups)
+    *wakeups = scheduler->wakeups;
+  if (max_dispatch_time)
+    *max_dispatch_time = scheduler->max_dispatch_time;
+}
+
+/* Wakeups per second within window of time up to now. Only the most recent
+ * wakeups are remembered, so rate of a denser burst is measured over the span
+ * of remembered ones instead of the whole window. */
+gdouble
+scheduler_get_wakeup_rate(Scheduler *scheduler, GTimeSpan window)
+{
+  gint64 now, oldest;
+  guint remembered, count = 0;
+
+  g_return_val_if_fail(scheduler != NULL, 0.0);
+  g_return_val_if_fail(window > 0, 0.0);
+
+  now = clock_get_monotonic_time(scheduler->clock);
+  oldest = now;
+  remembered = MIN(scheduler->wakeups, SCHEDULER_RECENT_WAKEUPS);
+  for (guint i = 0; i < remembered; i++)
+    if (scheduler->recent_wakeups[i] > now - window)
+    {
+      count++;
+      oldest = MIN(oldest, scheduler->recent_wakeups[i]);
+    }
+
+  // Span of remembered wakeups holds one interval less than their count
+  if (count == SCHEDULER_RECENT_WAKEUPS && now > oldest)
+    return (gdouble) (count - 1) * G_USEC_PER_SEC / (now - oldest);
+
+  return (gdouble) count * G_USEC_PER_SEC / window;
+}
+
+/* Stops dispatching until resumed. Entries can still be added and removed,
+ * so many of them can be rescheduled without rearming timer each time. */
+void
+scheduler_pause(Scheduler *scheduler)
+{
+  g_return_if_fail(scheduler != NULL);
+
+  scheduler->paused = TRUE;
+  scheduler_arm(scheduler);
+}
+
+// Entries which expired while paused are dispatched at once
+void
+scheduler_resume(Scheduler *scheduler)
+{
+  g_return_if_fail(scheduler != NULL);
+
+  scheduler->paused = FALSE;
+  scheduler_arm(scheduler);
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_SCHEDULER_H__
+#define __ALARM_PLUGIN_SCHEDULER_H__
+
+G_BEGIN_DECLS
+
+#define SCHEDULER_NO_DEADLINE G_MAXINT64
+
+typedef void (*SchedulerFunc) (gpointer key, gpointer user_data);
+
+typedef struct _Scheduler Scheduler;
+
+Scheduler* scheduler_new(Clock *clock);
+void scheduler_free(Scheduler *scheduler);
+
+void scheduler_add(Scheduler *scheduler, gpointer key, gint64 deadline,
+                   SchedulerFunc func, gpointer user_data);
+gboolean scheduler_remove(Scheduler *scheduler, gpointer key);
+gboolean scheduler_contains(Scheduler *scheduler, gpointer key);
+gint64 scheduler_next_deadline(Scheduler *scheduler);
+gint64 scheduler_get_time(Scheduler *scheduler);
+void scheduler_get_stats(Scheduler *scheduler, guint64 *wakeups, gint64 *max_dispatch_time);
+gdouble scheduler_get_wakeup_rate(Scheduler *scheduler, GTimeSpan window);
+void scheduler_pause(Scheduler *scheduler);
+void scheduler_resume(Scheduler *scheduler);
+
+// Introspection of the heap, only used by tests
+gint64 scheduler_get_deadline(Scheduler *scheduler, gpointer key);
+gpointer scheduler_next_key(Scheduler *scheduler);
+guint scheduler_size(Scheduler *scheduler);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_SCHEDULER_H__ */
@@ -0,0 +1,358 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <canberra.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "sound-player.h"
+
+/* Plugin wide sound service with single libcanberra context. Every sound file
+ * gets its own event id, so once uploaded to sound server, sample is reused
+ * by all later previews, alerts and loops instead of being decoded again.
+ * libcanberra has no call to remove sample from cache. Samples are uploaded
+ * as volatile, so server may drop them, and sample evicted from size budget
+ * is only forgotten here - it is played from file afterwards. */
+struct _SoundPlayer
+{
+  ca_context *context;
+
+  GHashTable *samples; // filename => Sample*
+  GQueue *lru; // Sample*, most recently used first
+  gsize cache_size;
+  gsize cache_budget;
+  guint next_sample_id;
+  GThreadPool *uploads; // Blocking cache uploads are done off main thread
+
+  GHashTable *playbacks; // playback id => Playback*
+  guint next_playback_id;
+};
+
+typedef struct
+{
+  gchar *filename;
+  gchar *event_id;
+  gsize size;
+  GList *lru_link;
+} Sample;
+
+typedef struct
+{
+  SoundPlayer *player; // NULL once player is freed
+  guint id;
+  gchar *filename;
+  guint loops_left; // SOUND_PLAYER_LOOP_FOREVER - until stopped
+  gboolean stopped;
+  SoundPlayerFinishedFunc func;
+  gpointer user_data;
+  int error; // Set from libcanberra thread
+} Playback;
+
+typedef struct
+{
+  gchar *filename;
+  gchar *event_id;
+} Upload;
+
+
+// Utilities
+static void
+sample_free(Sample *sample)
+{
+  g_free(sample->filename);
+  g_free(sample->event_id);
+  g_slice_free(Sample, sample);
+}
+
+static void
+playback_free(Playback *playback)
+{
+  g_free(playback->filename);
+  g_slice_free(Playback, playback);
+}
+
+static ca_proplist*
+sample_proplist(const gchar *filename, Sample *sample)
+{
+  ca_proplist *proplist;
+
+  g_warn_if_fail(!ca_proplist_create(&proplist));
+  g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_MEDIA_FILENAME, filename));
+  if (sample)
+  {
+    g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_EVENT_ID, sample->event_id));
+    g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_CANBERRA_CACHE_CONTROL, "volatile"));
+  }
+  else
+    g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_CANBERRA_CACHE_CONTROL, "never"));
+
+  return proplist;
+}
+
+static void
+sample_evict(SoundPlayer *player, Sample *sample)
+{
+  player->cache_size -= sample->size;
+  g_queue_delete_link(player->lru, sample->lru_link);
+  g_hash_table_remove(player->samples, sample->filename);
+}
+
+// Marks sample as most recently used; returns NULL for sounds that are not cached
+static Sample*
+sample_lookup(SoundPlayer *player, const gchar *filename)
+{
+  Sample *sample;
+
+  sample = g_hash_table_lookup(player->samples, filename);
+  if (sample)
+  {
+    g_queue_unlink(player->lru, sample->lru_link);
+    g_queue_push_head_link(player->lru, sample->lru_link);
+  }
+
+  return sample;
+}
+
+// Runs in upload thread
+static void
+upload_sample(gpointer data, gpointer user_data)
+{
+  Upload *upload = data;
+  SoundPlayer *player = user_data;
+  ca_proplist *proplist;
+  int error;
+
+  g_warn_if_fail(!ca_proplist_create(&proplist));
+  g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_MEDIA_FILENAME, upload->filename));
+  g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_EVENT_ID, upload->event_id));
+  g_warn_if_fail(!ca_proplist_sets(proplist, CA_PROP_CANBERRA_CACHE_CONTROL, "volatile"));
+
+  error = ca_context_cache_full(player->context, proplist);
+  if (error != CA_SUCCESS)
+    g_message("Failed to cache sound '%s': %s", upload->filename, ca_strerror(error));
+
+  g_warn_if_fail(!ca_proplist_destroy(proplist));
+  g_free(upload->filename);
+  g_free(upload->event_id);
+  g_slice_free(Upload, upload);
+}
+
+static void playback_finished(ca_context *c, uint32_t id, int error_code, void *data);
+
+static gboolean
+playback_start(SoundPlayer *player, Playback *playback)
+{
+  ca_proplist *proplist;
+  int error;
+
+  proplist = sample_proplist(playback->filename, sample_lookup(player, playback->filename));
+  error = ca_context_play_full(player->context, playback->id, proplist, playback_finished,
+                               playback);
+  g_warn_if_fail(!ca_proplist_destroy(proplist));
+
+  if (error != CA_SUCCESS)
+    g_message("Failed to play sound '%s': %s", playback->filename, ca_strerror(error));
+
+  return error == CA_SUCCESS;
+}
+
+
+// Callbacks
+static gboolean
+playback_loop(gpointer data)
+{
+  Playback *playback = data;
+  SoundPlayer *player = playback->player;
+
+  if (player == NULL)
+  {
+    playback_free(playback);
+    return G_SOURCE_REMOVE;
+  }
+
+  if (playback->error == CA_SUCCESS && !playback->stopped)
+  {
+    if (playback->loops_left == SOUND_PLAYER_LOOP_FOREVER ||
+        --playback->loops_left > 0)
+      if (playback_start(player, playback))
+        return G_SOURCE_REMOVE;
+  }
+
+  g_hash_table_steal(player->playbacks, GUINT_TO_POINTER(playback->id));
+  if (playback->func)
+    playback->func(playback->id, playback->user_data);
+  playback_free(playback);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Called from libcanberra thread
+static void
+playback_finished(ca_context *c, uint32_t id, int error_code, void *data)
+{
+  Playback *playback = data;
+
+  playback->error = error_code;
+  g_idle_add(playback_loop, playback);
+}
+
+
+// External interface
+SoundPlayer*
+sound_player_new(gsize cache_budget)
+{
+  SoundPlayer *player = g_slice_new0(SoundPlayer);
+
+  if (ca_context_create(&player->context) != CA_SUCCESS)
+  {
+    g_warn_if_reached();
+    g_slice_free(SoundPlayer, player);
+    return NULL;
+  }
+
+  player->samples = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                          (GDestroyNotify) sample_free);
+  player->lru = g_queue_new();
+  player->cache_budget = cache_budget;
+  player->uploads = g_thread_pool_new(upload_sample, player, 1, FALSE, NULL);
+  player->playbacks = g_hash_table_new(NULL, NULL);
+  player->next_playback_id = SOUND_PLAYER_NO_PLAYBACK + 1;
+
+  return player;
+}
+
+void
+sound_player_free(SoundPlayer *player)
+{
+  GList *pending, *iter;
+  Playback *playback;
+
+  if (player == NULL)
+    return;
+
+  /* Owners of pending playbacks are told they finished, so they release
+   * references held for the callback. Playbacks themselves are released
+   * from main loop once libcanberra reports them cancelled. */
+  pending = g_hash_table_get_values(player->playbacks);
+  g_hash_table_remove_all(player->playbacks);
+  for (iter = pending; iter != NULL; iter = iter->next)
+  {
+    playback = iter->data;
+    playback->player = NULL;
+    playback->stopped = TRUE;
+    if (playback->func)
+      playback->func(playback->id, playback->user_data);
+    playback->func = NULL;
+  }
+  g_list_free(pending);
+  g_hash_table_destroy(player->playbacks);
+
+  g_thread_pool_free(player->uploads, TRUE, TRUE);
+  ca_context_destroy(player->context);
+
+  g_queue_free(player->lru);
+  g_hash_table_destroy(player->samples);
+
+  g_slice_free(SoundPlayer, player);
+}
+
+/* Uploads sound to sound server ahead of playback. Least recently used
+ * samples are forgotten when total size of sound files exceeds budget. */
+void
+sound_player_cache(SoundPlayer *player, const gchar *filename)
+{
+  Sample *sample;
+  Upload *upload;
+  GStatBuf stat_buf;
+
+  g_return_if_fail(player != NULL);
+
+  if (filename == NULL || sample_lookup(player, filename))
+    return;
+
+  if (g_stat(filename, &stat_buf) || (gsize) stat_buf.st_size > player->cache_budget)
+    return;
+
+  while (player->cache_size + stat_buf.st_size > player->cache_budget)
+    sample_evict(player, g_queue_peek_tail(player->lru));
+
+  sample = g_slice_new(Sample);
+  sample->filename = g_strdup(filename);
+  sample->event_id = g_strdup_printf("xfce4-alarm-plugin-sound-%u", player->next_sample_id++);
+  sample->size = stat_buf.st_size;
+  g_queue_push_head(player->lru, sample);
+  sample->lru_link = g_queue_peek_head_link(player->lru);
+  g_hash_table_insert(player->samples, sample->filename, sample);
+  player->cache_size += sample->size;
+
+  upload = g_slice_new(Upload);
+  upload->filename = g_strdup(filename);
+  upload->event_id = g_strdup(sample->event_id);
+  g_thread_pool_push(player->uploads, upload, NULL);
+}
+
+/* Plays sound given number of times (SOUND_PLAYER_LOOP_FOREVER - until
+ * stopped). Function is called once playback finishes, fails or is stopped. */
+guint
+sound_player_play(SoundPlayer *player, const gchar *filename, guint loops,
+                  SoundPlayerFinishedFunc func, gpointer user_data)
+{
+  Playback *playback;
+
+  g_return_val_if_fail(player != NULL, SOUND_PLAYER_NO_PLAYBACK);
+  g_return_val_if_fail(filename != NULL, SOUND_PLAYER_NO_PLAYBACK);
+
+  sound_player_cache(player, filename);
+
+  playback = g_slice_new0(Playback);
+  playback->player = player;
+  playback->id = player->next_playback_id++;
+  playback->filename = g_strdup(filename);
+  playback->loops_left = loops;
+  playback->func = func;
+  playback->user_data = user_data;
+
+  if (!playback_start(player, playback))
+  {
+    playback_free(playback);
+    return SOUND_PLAYER_NO_PLAYBACK;
+  }
+
+  g_hash_table_insert(player->playbacks, GUINT_TO_POINTER(playback->id), playback);
+  return playback->id;
+}
+
+void
+sound_player_stop(SoundPlayer *player, guint playback_id)
+{
+  Playback *playback;
+
+  g_return_if_fail(player != NULL);
+
+  playback = g_hash_table_lookup(player->playbacks, GUINT_TO_POINTER(playback_id));
+  if (playback == NULL)
+    return;
+
+  // Playback may be between loops, so it has to be prevented from restarting
+  playback->stopped = TRUE;
+  g_warn_if_fail(!ca_context_cancel(player->context, playback_id));
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_SOUND_PLAYER_H__
+#define __ALARM_PLUGIN_SOUND_PLAYER_H__
+
+G_BEGIN_DECLS
+
+#define SOUND_PLAYER_NO_PLAYBACK 0
+#define SOUND_PLAYER_LOOP_FOREVER 0
+
+typedef void (*SoundPlayerFinishedFunc) (guint playback_id, gpointer user_data);
+
+typedef struct _SoundPlayer SoundPlayer;
+
+SoundPlayer* sound_player_new(gsize cache_budget);
+void sound_player_free(SoundPlayer *player);
+
+void sound_player_cache(SoundPlayer *player, const gchar *filename);
+guint sound_player_play(SoundPlayer *player, const gchar *filename, guint loops,
+                        SoundPlayerFinishedFunc func, gpointer user_data);
+void sound_player_stop(SoundPlayer *player, guint playback_id);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_SOUND_PLAYER_H__ */
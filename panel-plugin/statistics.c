@@ -0,0 +1,262 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "xfconf-batch.h"
+#include "sound-player.h"
+#include "notification.h"
+#include "alert-executor.h"
+#include "alert-coalescer.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+#include "statistics.h"
+
+#define STATISTICS_NAME_FORMAT "org.xfce.AlarmPlugin.Plugin%d"
+#define STATISTICS_PATH "/org/xfce/AlarmPlugin/Statistics"
+#define STATISTICS_INTERFACE "org.xfce.AlarmPlugin.Statistics"
+
+// Window of SchedulerWakeupsPerSecond, so recent bursts are not averaged away
+#define STATISTICS_RATE_WINDOW (60 * G_USEC_PER_SEC)
+
+// Times are in microseconds
+static const gchar introspection_xml[] =
+  "<node>"
+  "  <interface name='" STATISTICS_INTERFACE "'>"
+  "    <property name='Alarms' type='u' access='read'/>"
+  "    <property name='RunningAlarms' type='u' access='read'/>"
+  "    <property name='SchedulerWakeups' type='t' access='read'/>"
+  "    <property name='SchedulerWakeupsPerSecond' type='d' access='read'/>"
+  "    <property name='XfconfWrites' type='u' access='read'/>"
+  "    <property name='AlertFires' type='t' access='read'/>"
+  "    <property name='AverageDispatchLatency' type='x' access='read'/>"
+  "    <property name='MaxStall' type='x' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+/* Read-only counters of what plugin costs at runtime, exported on session bus
+ * as properties of STATISTICS_INTERFACE at STATISTICS_PATH, under name
+ * org.xfce.AlarmPlugin.Plugin<plugin id>. Values are gathered from scheduler,
+ * coalescer and settings of alarm context only when queried. */
+struct _Statistics
+{
+  AlarmContext *context;
+  gint plugin_id;
+
+  GDBusNodeInfo *node_info;
+  GDBusConnection *connection; // NULL until connected
+  guint registration_id;
+  guint owner_id;
+  GCancellable *cancellable; // Cancels connecting once statistics are freed
+};
+
+/* Main loop stalls are measured by wrapping poll function of default main
+ * context: everything between poll returning and the next poll - timeouts,
+ * idles, D-Bus replies, signal handlers building dialogs - is main loop busy.
+ * Panel runs external plugins in their own wrapper process, so all of it is
+ * attributable to the plugin. Shared by all statistics in process. */
+static GPollFunc default_poll = NULL;
+static guint poll_users = 0;
+static gint64 poll_returned_at = 0;
+static gint64 max_main_loop_stall = 0;
+
+
+// Utilities
+static guint
+running_alarm_count(AlarmContext *context)
+{
+  guint count = 0;
+
+  for (guint i = 0; i < context->alarms->len; i++)
+    if (((Alarm*) g_ptr_array_index(context->alarms, i))->started_at)
+      count++;
+
+  return count;
+}
+
+
+// Callbacks
+static gint
+statistics_poll(GPollFD *fds, guint n_fds, gint timeout)
+{
+  gint result;
+
+  if (poll_returned_at)
+    max_main_loop_stall = MAX(max_main_loop_stall,
+                              g_get_monotonic_time() - poll_returned_at);
+
+  result = default_poll(fds, n_fds, timeout);
+  poll_returned_at = g_get_monotonic_time();
+
+  return result;
+}
+
+static GVariant*
+statistics_get_property(GDBusConnection *connection, const gchar *sender,
+                        const gchar *object_path, const gchar *interface_name,
+                        const gchar *property_name, GError **error, gpointer user_data)
+{
+  Statistics *statistics = user_data;
+  AlarmContext *context = statistics->context;
+  guint64 wakeups, alerts;
+  gint64 total_latency;
+
+  if (!g_strcmp0(property_name, "Alarms"))
+    return g_variant_new_uint32(context->alarms->len);
+
+  if (!g_strcmp0(property_name, "RunningAlarms"))
+    return g_variant_new_uint32(running_alarm_count(context));
+
+  if (!g_strcmp0(property_name, "SchedulerWakeups"))
+  {
+    scheduler_get_stats(context->scheduler, &wakeups, NULL);
+    return g_variant_new_uint64(wakeups);
+  }
+
+  if (!g_strcmp0(property_name, "SchedulerWakeupsPerSecond"))
+    return g_variant_new_double(scheduler_get_wakeup_rate(context->scheduler,
+                                                          STATISTICS_RATE_WINDOW));
+
+  if (!g_strcmp0(property_name, "XfconfWrites"))
+    return g_variant_new_uint32(context->settings ?
+                                xfconf_batch_get_write_count(context->settings) : 0);
+
+  if (!g_strcmp0(property_name, "AlertFires") ||
+      !g_strcmp0(property_name, "AverageDispatchLatency"))
+  {
+    // Latency ends when alert is fired, after coalescing window
+    alert_coalescer_get_stats(context->coalescer, &alerts, &total_latency);
+    if (!g_strcmp0(property_name, "AlertFires"))
+      return g_variant_new_uint64(alerts);
+
+    return g_variant_new_int64(alerts ? total_latency / (gint64) alerts : 0);
+  }
+
+  if (!g_strcmp0(property_name, "MaxStall"))
+    return g_variant_new_int64(max_main_loop_stall);
+
+  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+              "Unknown property: %s", property_name);
+  return NULL;
+}
+
+static const GDBusInterfaceVTable interface_vtable =
+{
+  NULL,
+  statistics_get_property,
+  NULL
+};
+
+static void
+bus_ready(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+  Statistics *statistics;
+  GDBusConnection *connection;
+  gchar *name;
+  GError *error = NULL;
+
+  connection = g_bus_get_finish(result, &error);
+  if (connection == NULL)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_message("Failed to connect to session bus: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  statistics = user_data;
+  statistics->connection = connection;
+  statistics->registration_id =
+    g_dbus_connection_register_object(connection, STATISTICS_PATH,
+                                      statistics->node_info->interfaces[0],
+                                      &interface_vtable, statistics, NULL, &error);
+  if (statistics->registration_id == 0)
+  {
+    g_message("Failed to export statistics: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  name = g_strdup_printf(STATISTICS_NAME_FORMAT, statistics->plugin_id);
+  statistics->owner_id = g_bus_own_name_on_connection(connection, name,
+                                                      G_BUS_NAME_OWNER_FLAGS_NONE,
+                                                      NULL, NULL, NULL, NULL);
+  g_free(name);
+}
+
+
+// External interface
+Statistics*
+statistics_new(AlarmContext *context, gint plugin_id)
+{
+  Statistics *statistics;
+
+  g_return_val_if_fail(context != NULL, NULL);
+
+  statistics = g_slice_new0(Statistics);
+  statistics->context = context;
+  statistics->plugin_id = plugin_id;
+  statistics->node_info = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+  statistics->cancellable = g_cancellable_new();
+
+  g_bus_get(G_BUS_TYPE_SESSION, statistics->cancellable, bus_ready, statistics);
+
+  if (poll_users++ == 0)
+  {
+    default_poll = g_main_context_get_poll_func(NULL);
+    g_main_context_set_poll_func(NULL, statistics_poll);
+  }
+
+  return statistics;
+}
+
+void
+statistics_free(Statistics *statistics)
+{
+  if (statistics == NULL)
+    return;
+
+  g_cancellable_cancel(statistics->cancellable);
+  g_object_unref(statistics->cancellable);
+
+  if (--poll_users == 0)
+  {
+    g_main_context_set_poll_func(NULL, default_poll);
+    poll_returned_at = 0;
+  }
+
+  if (statistics->owner_id)
+    g_bus_unown_name(statistics->owner_id);
+  if (statistics->registration_id)
+    g_dbus_connection_unregister_object(statistics->connection,
+                                        statistics->registration_id);
+  g_clear_object(&statistics->connection);
+  g_dbus_node_info_unref(statistics->node_info);
+
+  g_slice_free(Statistics, statistics);
+}
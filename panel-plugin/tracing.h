@@ -0,0 +1,46 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef __ALARM_PLUGIN_TRACING_H__
+#define __ALARM_PLUGIN_TRACING_H__
+
+/* Marks of hot paths recorded by sysprof when built with --enable-tracing,
+ * and compiled out otherwise. Marks carry duration and printf-style message:
+ *
+ *   gint64 trace_start;
+ *
+ *   TRACE_BEGIN(trace_start);
+ *   ...
+ *   TRACE_END(trace_start, "load settings", "%u alarms", count);
+ */
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+
+#define TRACE_GROUP "xfce4-alarm-plugin"
+
+#define TRACE_BEGIN(start) ((start) = SYSPROF_CAPTURE_CURRENT_TIME)
+#define TRACE_END(start, name, ...) \
+  sysprof_collector_mark((start), SYSPROF_CAPTURE_CURRENT_TIME - (start), \
+                         TRACE_GROUP, (name), __VA_ARGS__)
+#else
+#define TRACE_BEGIN(start) ((start) = 0)
+#define TRACE_END(start, name, ...) ((void) (start))
+#endif
+
+#endif /* !__ALARM_PLUGIN_TRACING_H__ */
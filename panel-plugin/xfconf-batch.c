@@ -0,0 +1,412 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <xfconf/xfconf.h>
+
+#include "profiler.h"
+#include "xfconf-batch.h"
+
+/* Every xfconf write is a synchronous D-Bus round trip. Batch keeps a snapshot
+ * of persisted values, so only changed properties are written, and defers all
+ * writes to a single flush per main loop iteration. The flush itself still
+ * makes one round trip per changed property (or recursive reset): xfconf has
+ * no call setting several distinct properties at once, set_arrayv() only
+ * stores an array under a single property. */
+struct _XfconfBatch
+{
+  XfconfChannel *channel;
+  Profiler *profiler;
+  GHashTable *snapshot; // property => GValue* (NULL - known to be unset)
+  GHashTable *pending; // property => GValue* (NULL - reset)
+  GPtrArray *pending_resets; // recursively reset property bases
+
+  guint flush_id;
+  guint write_count;
+};
+
+
+// Utilities
+static GValue*
+value_dup(const GValue *value)
+{
+  GValue *copy;
+
+  if (value == NULL)
+    return NULL;
+
+  copy = g_new0(GValue, 1);
+  g_value_init(copy, G_VALUE_TYPE(value));
+  g_value_copy(value, copy);
+  return copy;
+}
+
+static void
+value_free(gpointer value)
+{
+  if (value == NULL)
+    return;
+
+  g_value_unset(value);
+  g_free(value);
+}
+
+static gboolean
+values_equal(const GValue *left, const GValue *right)
+{
+  if (left == NULL || right == NULL)
+    return left == right;
+
+  if (G_VALUE_TYPE(left) != G_VALUE_TYPE(right))
+    return FALSE;
+
+  switch (G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(left)))
+  {
+    case G_TYPE_BOOLEAN:
+      return g_value_get_boolean(left) == g_value_get_boolean(right);
+    case G_TYPE_INT:
+      return g_value_get_int(left) == g_value_get_int(right);
+    case G_TYPE_UINT:
+      return g_value_get_uint(left) == g_value_get_uint(right);
+    case G_TYPE_INT64:
+      return g_value_get_int64(left) == g_value_get_int64(right);
+    case G_TYPE_UINT64:
+      return g_value_get_uint64(left) == g_value_get_uint64(right);
+    case G_TYPE_DOUBLE:
+      return g_value_get_double(left) == g_value_get_double(right);
+    case G_TYPE_STRING:
+      return !g_strcmp0(g_value_get_string(left), g_value_get_string(right));
+    default:
+      return FALSE;
+  }
+}
+
+static gboolean
+property_has_base(gpointer property, gpointer value, gpointer base)
+{
+  gsize base_len = strlen(base);
+
+  return !strncmp(property, base, base_len) &&
+         (((gchar*) property)[base_len] == '\0' || ((gchar*) property)[base_len] == '/');
+}
+
+static gboolean
+property_persisted_under_base(gpointer property, gpointer value, gpointer base)
+{
+  return value != NULL && property_has_base(property, value, base);
+}
+
+static gboolean
+batch_flush_idle(gpointer data)
+{
+  XfconfBatch *batch = data;
+
+  batch->flush_id = 0;
+  xfconf_batch_flush(batch);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+batch_schedule_flush(XfconfBatch *batch)
+{
+  if (batch->flush_id == 0)
+    batch->flush_id = g_idle_add(batch_flush_idle, batch);
+}
+
+
+// External interface
+/* Converts GObject property value to type storable by xfconf. Returns FALSE if
+ * property has no value, in which case it should be reset instead. */
+gboolean
+xfconf_value_from_property(const GValue *value, GValue *xfconf_value)
+{
+  GType type = G_VALUE_TYPE(value);
+  GDateTime *date_time;
+  GdkRGBA *color;
+
+  if (type == G_TYPE_DATE_TIME)
+  {
+    date_time = g_value_get_boxed(value);
+    if (date_time == NULL)
+      return FALSE;
+
+    g_value_init(xfconf_value, G_TYPE_INT64);
+    g_value_set_int64(xfconf_value,
+                      g_date_time_to_unix(date_time)*G_USEC_PER_SEC +
+                      g_date_time_get_microsecond(date_time));
+  }
+  else if (type == GDK_TYPE_RGBA)
+  {
+    color = g_value_get_boxed(value);
+    if (color == NULL)
+      return FALSE;
+
+    g_value_init(xfconf_value, G_TYPE_STRING);
+    g_value_take_string(xfconf_value, gdk_rgba_to_string(color));
+  }
+  else if (type == G_TYPE_STRING && g_value_get_string(value) == NULL)
+    return FALSE;
+  else
+  {
+    g_value_init(xfconf_value, type);
+    g_value_copy(value, xfconf_value);
+  }
+
+  return TRUE;
+}
+
+/* Converts value read from xfconf to GObject property type. 'value' has to be
+ * initialized to property type beforehand. */
+gboolean
+xfconf_value_to_property(const GValue *xfconf_value, GValue *value)
+{
+  GType type = G_VALUE_TYPE(value);
+  GDateTime *date_time;
+  GdkRGBA color;
+  gint64 usecs;
+
+  g_return_val_if_fail(G_IS_VALUE(xfconf_value), FALSE);
+  g_return_val_if_fail(G_IS_VALUE(value), FALSE);
+
+  if (type == G_TYPE_DATE_TIME)
+  {
+    if (!G_VALUE_HOLDS_INT64(xfconf_value))
+      return FALSE;
+
+    usecs = g_value_get_int64(xfconf_value);
+    date_time = g_date_time_new_from_unix_utc(usecs / G_USEC_PER_SEC);
+    g_value_take_boxed(value, g_date_time_add(date_time, usecs % G_USEC_PER_SEC));
+    g_date_time_unref(date_time);
+  }
+  else if (type == GDK_TYPE_RGBA)
+  {
+    if (!G_VALUE_HOLDS_STRING(xfconf_value) ||
+        !gdk_rgba_parse(&color, g_value_get_string(xfconf_value)))
+      return FALSE;
+
+    g_value_set_boxed(value, &color);
+  }
+  else
+    return g_value_transform(xfconf_value, value);
+
+  return TRUE;
+}
+
+XfconfBatch*
+xfconf_batch_new(const gchar *channel_name, Profiler *profiler)
+{
+  XfconfBatch *batch;
+
+  g_return_val_if_fail(channel_name != NULL, NULL);
+  g_return_val_if_fail(profiler != NULL, NULL);
+
+  batch = g_slice_new0(XfconfBatch);
+  batch->channel = g_object_ref(xfconf_channel_get(channel_name));
+  batch->profiler = profiler;
+  batch->snapshot = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, value_free);
+  batch->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, value_free);
+  batch->pending_resets = g_ptr_array_new_with_free_func(g_free);
+
+  return batch;
+}
+
+void
+xfconf_batch_free(XfconfBatch *batch)
+{
+  if (batch == NULL)
+    return;
+
+  xfconf_batch_flush(batch);
+
+  g_hash_table_destroy(batch->snapshot);
+  g_hash_table_destroy(batch->pending);
+  g_ptr_array_free(batch->pending_resets, TRUE);
+  g_object_unref(batch->channel);
+
+  g_slice_free(XfconfBatch, batch);
+}
+
+// Records value known to be persisted already (e.g. after loading settings)
+void
+xfconf_batch_snapshot(XfconfBatch *batch, const gchar *property, const GValue *value)
+{
+  g_return_if_fail(batch != NULL);
+  g_return_if_fail(property != NULL);
+
+  g_hash_table_replace(batch->snapshot, g_strdup(property), value_dup(value));
+}
+
+void
+xfconf_batch_set(XfconfBatch *batch, const gchar *property, const GValue *value)
+{
+  gpointer persisted;
+
+  g_return_if_fail(batch != NULL);
+  g_return_if_fail(property != NULL);
+  g_return_if_fail(G_IS_VALUE(value));
+
+  if (g_hash_table_lookup_extended(batch->snapshot, property, NULL, &persisted) &&
+      values_equal(persisted, value))
+    return;
+
+  g_hash_table_replace(batch->snapshot, g_strdup(property), value_dup(value));
+  g_hash_table_replace(batch->pending, g_strdup(property), value_dup(value));
+  batch_schedule_flush(batch);
+}
+
+void
+xfconf_batch_set_uint(XfconfBatch *batch, const gchar *property, guint value)
+{
+  GValue uint_value = G_VALUE_INIT;
+
+  g_value_init(&uint_value, G_TYPE_UINT);
+  g_value_set_uint(&uint_value, value);
+  xfconf_batch_set(batch, property, &uint_value);
+  g_value_unset(&uint_value);
+}
+
+/* Object valued properties are skipped - their owner has to store them in
+ * a form that can be resolved back on load (e.g. id). */
+void
+xfconf_batch_set_object(XfconfBatch *batch, const gchar *prefix, GObject *object)
+{
+  GParamSpec **specs;
+  guint spec_count, i;
+  gchar *property;
+  GValue value = G_VALUE_INIT, xfconf_value = G_VALUE_INIT;
+
+  g_return_if_fail(batch != NULL);
+  g_return_if_fail(G_IS_OBJECT(object));
+
+  specs = g_object_class_list_properties(G_OBJECT_GET_CLASS(object), &spec_count);
+
+  for (i = 0; i < spec_count; i++)
+  {
+    if ((specs[i]->flags & G_PARAM_READWRITE) == 0 ||
+        (specs[i]->flags & XFCONF_BATCH_PARAM_RUNTIME) ||
+        G_TYPE_IS_OBJECT(specs[i]->value_type))
+      continue;
+
+    property = g_strdup_printf("%s/%s", prefix ? prefix : "",
+                               g_param_spec_get_name(specs[i]));
+    g_object_get_property(object, g_param_spec_get_name(specs[i]), &value);
+    if (xfconf_value_from_property(&value, &xfconf_value))
+    {
+      xfconf_batch_set(batch, property, &xfconf_value);
+      g_value_unset(&xfconf_value);
+    }
+    else
+      xfconf_batch_reset(batch, property, FALSE);
+    g_value_unset(&value);
+    g_free(property);
+  }
+
+  g_free(specs);
+}
+
+void
+xfconf_batch_reset(XfconfBatch *batch, const gchar *property, gboolean recursive)
+{
+  gpointer persisted;
+
+  g_return_if_fail(batch != NULL);
+  g_return_if_fail(property != NULL);
+
+  if (recursive)
+  {
+    /* Snapshot holds whole loaded subtree, if nothing is persisted or pending
+     * under base there is nothing to reset and no round trip to make */
+    if (g_hash_table_find(batch->snapshot, property_persisted_under_base,
+                          (gpointer) property) == NULL &&
+        g_hash_table_find(batch->pending, property_has_base, (gpointer) property) == NULL)
+      return;
+
+    // Recursive resets are flushed before writes, drop writes they would undo
+    g_hash_table_foreach_remove(batch->snapshot, property_has_base, (gpointer) property);
+    g_hash_table_foreach_remove(batch->pending, property_has_base, (gpointer) property);
+    g_ptr_array_add(batch->pending_resets, g_strdup(property));
+  }
+  else
+  {
+    if (g_hash_table_lookup_extended(batch->snapshot, property, NULL, &persisted) &&
+        persisted == NULL)
+      return;
+
+    g_hash_table_replace(batch->snapshot, g_strdup(property), NULL);
+    g_hash_table_replace(batch->pending, g_strdup(property), NULL);
+  }
+  batch_schedule_flush(batch);
+}
+
+void
+xfconf_batch_flush(XfconfBatch *batch)
+{
+  GHashTableIter ht_iter;
+  gchar *property;
+  GValue *value;
+  guint write_count;
+  gboolean written;
+
+  g_return_if_fail(batch != NULL);
+
+  if (batch->flush_id)
+    g_source_remove(batch->flush_id);
+  batch->flush_id = 0;
+
+  profiler_enter(batch->profiler, PROFILER_FLUSH_SETTINGS);
+  write_count = batch->write_count;
+
+  for (guint i = 0; i < batch->pending_resets->len; i++)
+  {
+    xfconf_channel_reset_property(batch->channel,
+                                  g_ptr_array_index(batch->pending_resets, i), TRUE);
+    batch->write_count++;
+  }
+  g_ptr_array_set_size(batch->pending_resets, 0);
+
+  g_hash_table_iter_init(&ht_iter, batch->pending);
+  while (g_hash_table_iter_next(&ht_iter, (gpointer) &property, (gpointer) &value))
+  {
+    if (value == NULL)
+      xfconf_channel_reset_property(batch->channel, property, FALSE);
+    else
+    {
+      written = xfconf_channel_set_property(batch->channel, property, value);
+      if (!written)
+        g_warning("Failed to write xfconf property %s.", property);
+    }
+    batch->write_count++;
+  }
+  g_hash_table_remove_all(batch->pending);
+
+  profiler_count_calls(batch->profiler, batch->write_count - write_count);
+  profiler_leave(batch->profiler, PROFILER_FLUSH_SETTINGS);
+}
+
+// Number of D-Bus round trips made to xfconf daemon so far
+guint
+xfconf_batch_get_write_count(XfconfBatch *batch)
+{
+  g_return_val_if_fail(batch != NULL, 0);
+
+  return batch->write_count;
+}
@@ -0,0 +1,47 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_XFCONF_BATCH_H__
+#define __ALARM_PLUGIN_XFCONF_BATCH_H__
+
+G_BEGIN_DECLS
+
+// Runtime state property, skipped by xfconf_batch_set_object()
+#define XFCONF_BATCH_PARAM_RUNTIME (1 << G_PARAM_USER_SHIFT)
+
+typedef struct _XfconfBatch XfconfBatch;
+
+gboolean xfconf_value_from_property(const GValue *value, GValue *xfconf_value);
+gboolean xfconf_value_to_property(const GValue *xfconf_value, GValue *value);
+
+XfconfBatch* xfconf_batch_new(const gchar *channel_name, Profiler *profiler);
+void xfconf_batch_free(XfconfBatch *batch);
+
+void xfconf_batch_snapshot(XfconfBatch *batch, const gchar *property,
+                           const GValue *value);
+void xfconf_batch_set(XfconfBatch *batch, const gchar *property, const GValue *value);
+void xfconf_batch_set_uint(XfconfBatch *batch, const gchar *property, guint value);
+void xfconf_batch_set_object(XfconfBatch *batch, const gchar *prefix, GObject *object);
+void xfconf_batch_reset(XfconfBatch *batch, const gchar *property, gboolean recursive);
+void xfconf_batch_flush(XfconfBatch *batch);
+
+guint xfconf_batch_get_write_count(XfconfBatch *batch);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_XFCONF_BATCH_H__ */
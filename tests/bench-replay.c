@@ -0,0 +1,112 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "sound-player.h"
+#include "notification.h"
+#include "alert-executor.h"
+#include "alert-coalescer.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+
+/* Replays a week of recurring clock alarms on the virtual clock, as fast as
+ * the scheduler can dispatch them, and checks every occurrence fired. Alerts
+ * only go through coalescer and executor - no notification, sound or program. */
+
+#define REPLAY_ALARMS 5000
+#define REPLAY_DAYS 7
+
+typedef struct
+{
+  gint rerun_every;
+  RerunMode rerun_mode;
+  guint fires; // In a week starting on Monday, with time of day after midnight
+} Rerun;
+
+static const Rerun reruns[] =
+{
+  {RERUN_EVERYDAY, RERUN_NDAYS, 7},
+  {RERUN_WEEKDAY, RERUN_NDAYS, 5},
+  {RERUN_WEEKEND, RERUN_NDAYS, 2},
+  {-2, RERUN_NDAYS, 4},
+};
+
+
+gint
+main(gint argc, gchar **argv)
+{
+  const Rerun *rerun;
+  AlarmContext *context;
+  GDateTime *start;
+  Alarm *alarm;
+  guint64 expected = 0, fires, wakeups;
+  gint64 started_at, wall_time, max_dispatch;
+
+  g_setenv("TZ", "UTC", TRUE);
+
+  start = g_date_time_new_utc(2020, 1, 6, 0, 0, 0);
+  context = alarm_context_new(clock_new_virtual(start), NULL, NULL);
+  g_object_set(context->alert, "notification", FALSE, NULL);
+  g_date_time_unref(start);
+
+  for (guint i = 0; i < REPLAY_ALARMS; i++)
+  {
+    rerun = &reruns[i % G_N_ELEMENTS(reruns)];
+    alarm = alarm_new();
+    g_object_set(alarm,
+                 "type", ALARM_TYPE_CLOCK,
+                 "time", 1 + i * 17 % (86400 - 1),
+                 "rerun-every", rerun->rerun_every,
+                 "rerun-mode", rerun->rerun_mode,
+                 NULL);
+    alarm_list_append(context, alarm);
+    start_alarm(context, alarm);
+    expected += rerun->fires;
+  }
+
+  started_at = g_get_monotonic_time();
+  for (guint day = 0; day < REPLAY_DAYS; day++)
+  {
+    clock_advance(context->clock, G_TIME_SPAN_DAY);
+    // Coalesced alerts are handed to executor from idle
+    while (g_main_context_iteration(NULL, FALSE));
+  }
+  wall_time = g_get_monotonic_time() - started_at;
+
+  alert_coalescer_get_stats(context->coalescer, &fires, NULL);
+  scheduler_get_stats(context->scheduler, &wakeups, &max_dispatch);
+
+  g_print("%u alarms, %u days: %" G_GUINT64_FORMAT " fires (%" G_GUINT64_FORMAT
+          " expected), %" G_GUINT64_FORMAT " wakeups\n",
+          REPLAY_ALARMS, REPLAY_DAYS, fires, expected, wakeups);
+  g_print("wall %.3f ms, %.3f us per fire, longest wakeup %" G_GINT64_FORMAT " us\n",
+          wall_time / 1000.0, fires ? (gdouble) wall_time / fires : 0.0, max_dispatch);
+
+  alarm_context_free(context);
+
+  return fires == expected ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+#include <xfconf/xfconf.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "profiler.h"
+#include "xfconf-batch.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+
+/* Measures settings paths against xfconfd: wall time and D-Bus round trips of
+ * saving, loading, reordering and removing N alarms. Run through 'make bench',
+ * which starts a private session bus with its own xfconfd, so the user's
+ * configuration is never touched. */
+
+#define BENCH_CHANNEL "xfce4-alarm-plugin-bench"
+#define BENCH_MOVES 100
+
+static const guint alarm_counts[] = {10, 100, 1000, 10000};
+
+typedef struct
+{
+  gint64 started_at;
+  guint64 calls;
+  gint64 flush_time; // Spent writing to xfconfd
+} Measurement;
+
+
+// Utilities
+static void
+measure_start(AlarmContext *context, Measurement *measurement)
+{
+  measurement->started_at = g_get_monotonic_time();
+  measurement->calls = profiler_get_calls(context->profiler);
+  profiler_get_section(context->profiler, PROFILER_FLUSH_SETTINGS, NULL,
+                       &measurement->flush_time, NULL, NULL);
+}
+
+static void
+measure_report(AlarmContext *context, Measurement *measurement, guint n_alarms,
+               const gchar *operation)
+{
+  gint64 wall_time, flush_time;
+
+  wall_time = g_get_monotonic_time() - measurement->started_at;
+  profiler_get_section(context->profiler, PROFILER_FLUSH_SETTINGS, NULL, &flush_time,
+                       NULL, NULL);
+  g_print("%8u  %-8s %12.3f %12.3f %12" G_GUINT64_FORMAT "\n", n_alarms, operation,
+          wall_time / 1000.0, (flush_time - measurement->flush_time) / 1000.0,
+          profiler_get_calls(context->profiler) - measurement->calls);
+}
+
+static AlarmContext*
+context_new(guint n_alarms)
+{
+  AlarmContext *context;
+  gchar *property_base;
+
+  property_base = g_strdup_printf("/plugins/plugin-%u", n_alarms);
+  context = alarm_context_new(clock_new(), BENCH_CHANNEL, property_base);
+  g_free(property_base);
+
+  return context;
+}
+
+// Every alarm gets a few non-default settings, as configured ones have
+static void
+bench_save(guint n_alarms)
+{
+  AlarmContext *context;
+  Alarm *alarm;
+  gchar *name;
+  Measurement measurement;
+
+  context = context_new(n_alarms);
+  for (guint i = 0; i < n_alarms; i++)
+  {
+    name = g_strdup_printf("Alarm %u", i);
+    alarm = alarm_new();
+    g_object_set(alarm,
+                 "type", i % 2 ? ALARM_TYPE_CLOCK : ALARM_TYPE_TIMER,
+                 "name", name,
+                 "time", 60 + i % (86400 - 60),
+                 "rerun-every", i % 2 ? RERUN_WEEKDAY : NO_RERUN,
+                 NULL);
+    alarm_list_append(context, alarm);
+    g_free(name);
+  }
+
+  measure_start(context, &measurement);
+  for (guint i = 0; i < n_alarms; i++)
+    save_alarm_settings(context, alarm_list_get(context, i));
+  xfconf_batch_flush(context->settings);
+  measure_report(context, &measurement, n_alarms, "save");
+
+  alarm_context_free(context);
+}
+
+static AlarmContext*
+bench_load(guint n_alarms)
+{
+  AlarmContext *context;
+  Measurement measurement;
+
+  context = context_new(n_alarms);
+
+  measure_start(context, &measurement);
+  g_ptr_array_unref(context->alarms);
+  context->alarms = load_alarm_settings(context);
+  measure_report(context, &measurement, n_alarms, "load");
+  g_warn_if_fail(context->alarms->len == n_alarms);
+
+  return context;
+}
+
+/* Last alarm is dragged to the top repeatedly, each drop flushed on its own.
+ * Gaps between order keys run out on the way, so renumbering is included. */
+static void
+bench_move(AlarmContext *context, guint n_alarms)
+{
+  Measurement measurement;
+
+  measure_start(context, &measurement);
+  for (guint i = 0; i < BENCH_MOVES; i++)
+  {
+    alarm_list_move(context, alarm_list_get(context, context->alarms->len - 1), 0);
+    xfconf_batch_flush(context->settings);
+  }
+  measure_report(context, &measurement, n_alarms, "move");
+}
+
+static void
+bench_reset(AlarmContext *context, guint n_alarms)
+{
+  Measurement measurement;
+
+  measure_start(context, &measurement);
+  for (guint i = 0; i < context->alarms->len; i++)
+    reset_alarm_settings(context, alarm_list_get(context, i));
+  xfconf_batch_flush(context->settings);
+  measure_report(context, &measurement, n_alarms, "reset");
+
+  g_ptr_array_set_size(context->alarms, 0);
+}
+
+
+gint
+main(gint argc, gchar **argv)
+{
+  AlarmContext *context;
+  XfconfChannel *channel;
+  GError *error = NULL;
+
+  if (!xfconf_init(&error))
+  {
+    g_printerr("Failed to connect to xfconfd: %s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  // Leftovers of an interrupted run would be loaded as well
+  channel = xfconf_channel_get(BENCH_CHANNEL);
+  xfconf_channel_reset_property(channel, "/", TRUE);
+
+  g_print("Move is %u drags of the last alarm to the top.\n\n", BENCH_MOVES);
+  g_print("%8s  %-8s %12s %12s %12s\n", "alarms", "op", "wall (ms)", "flush (ms)",
+          "D-Bus calls");
+  for (guint i = 0; i < G_N_ELEMENTS(alarm_counts); i++)
+  {
+    bench_save(alarm_counts[i]);
+    context = bench_load(alarm_counts[i]);
+    bench_move(context, alarm_counts[i]);
+    bench_reset(context, alarm_counts[i]);
+    alarm_context_free(context);
+  }
+
+  xfconf_channel_reset_property(channel, "/", TRUE);
+  xfconf_shutdown();
+
+  return 0;
+}
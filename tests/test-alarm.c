@@ -0,0 +1,181 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "common.h"
+#include "alert.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+
+/* Dialogs edit a copy of alarm and copy it back on confirmation, so copying
+ * has to carry every setting, but none of the runtime state. */
+
+
+// Tests
+static void
+test_alarm_dup(void)
+{
+  GdkRGBA color = {1.0, 0.5, 0.0, 1.0};
+  GDateTime *started_at;
+  Alarm *alarm, *copy;
+
+  started_at = g_date_time_new_utc(2020, 1, 1, 6, 0, 0);
+  alarm = alarm_new();
+  g_object_set(alarm,
+               "type", ALARM_TYPE_CLOCK,
+               "name", "Wake up",
+               "time", 7*3600,
+               "color", &color,
+               "autostart", TRUE,
+               "autostop-on-suspend", TRUE,
+               "rerun-every", RERUN_WEEKDAY,
+               "rerun-mode", RERUN_NWEEKS,
+               "started-at", started_at,
+               NULL);
+
+  copy = g_object_dup(G_OBJECT(alarm));
+  g_assert_true(ALARM_PLUGIN_IS_ALARM(copy));
+  g_assert_true(copy != alarm);
+  g_assert_cmpint(copy->type, ==, ALARM_TYPE_CLOCK);
+  g_assert_cmpstr(copy->name, ==, "Wake up");
+  g_assert_true(copy->name != alarm->name);
+  g_assert_cmpuint(copy->time, ==, 7*3600);
+  g_assert_nonnull(copy->color);
+  g_assert_true(copy->color != alarm->color);
+  g_assert_true(gdk_rgba_equal(copy->color, &color));
+  g_assert_true(copy->autostart);
+  g_assert_false(copy->autostop);
+  g_assert_false(copy->autostart_on_resume);
+  g_assert_true(copy->autostop_on_suspend);
+  g_assert_cmpint(copy->rerun_every, ==, RERUN_WEEKDAY);
+  g_assert_cmpint(copy->rerun_mode, ==, RERUN_NWEEKS);
+
+  // Runtime state stays with the source
+  g_assert_null(copy->started_at);
+  g_assert_null(copy->deadline);
+  g_assert_cmpuint(copy->id, ==, ALARM_ID_UNASSIGNED);
+
+  g_object_unref(copy);
+  g_object_unref(alarm);
+  g_date_time_unref(started_at);
+}
+
+static void
+test_alarm_copy(void)
+{
+  GDateTime *started_at;
+  Alarm *alarm, *timer, *copy;
+
+  started_at = g_date_time_new_utc(2020, 1, 1, 6, 0, 0);
+  timer = alarm_new();
+  alarm = alarm_new();
+  g_object_set(alarm, "name", "Tea", "time", 180, "triggered-timer", timer, NULL);
+  copy = alarm_new();
+  g_object_set(copy, "name", "Coffee", "started-at", started_at, NULL);
+
+  g_object_copy(G_OBJECT(alarm), G_OBJECT(copy));
+  g_assert_cmpstr(copy->name, ==, "Tea");
+  g_assert_cmpuint(copy->time, ==, 180);
+  g_assert_true(copy->triggered_timer == timer);
+  g_assert_null(copy->color);
+  // Destination keeps its own runtime state
+  g_assert_nonnull(copy->started_at);
+  g_assert_true(g_date_time_equal(copy->started_at, started_at));
+
+  // Copying from nothing leaves destination untouched
+  g_object_copy(NULL, G_OBJECT(copy));
+  g_assert_cmpstr(copy->name, ==, "Tea");
+  g_assert_null(g_object_dup(NULL));
+
+  g_object_unref(copy);
+  g_object_unref(alarm);
+  g_object_unref(timer);
+  g_date_time_unref(started_at);
+}
+
+static void
+test_alert_dup(void)
+{
+  Alert *alert, *defaults, *copy;
+  gchar *sound;
+  gint fd;
+
+  // Only existing files are accepted as sound
+  fd = g_file_open_tmp("alarm-test-XXXXXX.oga", &sound, NULL);
+  g_assert_cmpint(fd, >=, 0);
+  g_close(fd, NULL);
+
+  alert = alert_new();
+  g_object_set(alert,
+               "notification", FALSE,
+               "sound", sound,
+               "sound-loops", 3,
+               "program", "/usr/bin/true",
+               "program-options", "--help",
+               "program-runtime", 90,
+               "repeats", REPEAT_UNTIL_ACK,
+               "interval", 30,
+               NULL);
+  alert->repeats_left = 7;
+
+  copy = g_object_dup(G_OBJECT(alert));
+  g_assert_true(ALARM_PLUGIN_IS_ALERT(copy));
+  g_assert_false(copy->notification);
+  g_assert_cmpstr(copy->sound, ==, sound);
+  g_assert_true(copy->sound != alert->sound);
+  g_assert_cmpuint(copy->sound_loops, ==, 3);
+  g_assert_cmpstr(copy->program, ==, "/usr/bin/true");
+  g_assert_cmpstr(copy->program_options, ==, "--help");
+  g_assert_cmpuint(copy->program_runtime, ==, 90);
+  g_assert_cmpuint(copy->repeats, ==, REPEAT_UNTIL_ACK);
+  g_assert_cmpuint(copy->interval, ==, 30);
+  g_assert_cmpuint(copy->repeats_left, ==, 0);
+
+  // Copy over non-default settings restores defaults from source
+  defaults = alert_new();
+  g_object_copy(G_OBJECT(defaults), G_OBJECT(copy));
+  g_assert_true(copy->notification);
+  g_assert_null(copy->sound);
+  g_assert_null(copy->program);
+
+  g_object_unref(defaults);
+  g_object_unref(copy);
+  g_object_unref(alert);
+  g_unlink(sound);
+  g_free(sound);
+}
+
+
+gint
+main(gint argc, gchar **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/alarm/dup", test_alarm_dup);
+  g_test_add_func("/alarm/copy", test_alarm_copy);
+  g_test_add_func("/alert/dup", test_alert_dup);
+
+  return g_test_run();
+}
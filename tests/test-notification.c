@@ -0,0 +1,422 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "clock.h"
+#include "scheduler.h"
+#include "notification.h"
+#include "test-utils.h"
+
+#define NOTIFICATIONS_NAME "org.freedesktop.Notifications"
+#define NOTIFICATIONS_PATH "/org/freedesktop/Notifications"
+#define NOTIFICATIONS_INTERFACE "org.freedesktop.Notifications"
+#define CLOSED_EXPIRED 1
+#define CLOSED_DISMISSED 2
+#define CLOSED_BY_CALL 3
+
+static const gchar mock_daemon_xml[] =
+  "<node>"
+  "  <interface name='" NOTIFICATIONS_INTERFACE "'>"
+  "    <method name='Notify'>"
+  "      <arg type='s' name='app_name' direction='in'/>"
+  "      <arg type='u' name='replaces_id' direction='in'/>"
+  "      <arg type='s' name='app_icon' direction='in'/>"
+  "      <arg type='s' name='summary' direction='in'/>"
+  "      <arg type='s' name='body' direction='in'/>"
+  "      <arg type='as' name='actions' direction='in'/>"
+  "      <arg type='a{sv}' name='hints' direction='in'/>"
+  "      <arg type='i' name='expire_timeout' direction='in'/>"
+  "      <arg type='u' name='id' direction='out'/>"
+  "    </method>"
+  "    <method name='CloseNotification'>"
+  "      <arg type='u' name='id' direction='in'/>"
+  "    </method>"
+  "    <signal name='NotificationClosed'>"
+  "      <arg type='u' name='id'/>"
+  "      <arg type='u' name='reason'/>"
+  "    </signal>"
+  "    <signal name='ActionInvoked'>"
+  "      <arg type='u' name='id'/>"
+  "      <arg type='s' name='action_key'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+/* Notification daemon served on private session bus. It records calls and can hold Notify replies back,
+ * to reproduce a slow daemon. */
+typedef struct
+{
+  GDBusConnection *connection;
+  guint next_id;
+  GPtrArray *notify_calls; // MockNotify*
+  GArray *closed_ids; // Ids passed to CloseNotification
+  guint bubbles; // Currently on screen
+  gboolean hold_replies;
+} MockDaemon;
+
+typedef struct
+{
+  guint replaces_id;
+  guint id;
+  gchar *summary;
+  gchar *body;
+  gboolean stop_action;
+  GDBusMethodInvocation *held; // Reply not sent yet
+} MockNotify;
+
+typedef struct
+{
+  Clock *clock;
+  Scheduler *scheduler;
+  Notifier *notifier;
+  GArray *dismissed; // Handles reported by notifier
+} Fixture;
+
+static MockDaemon mock;
+
+
+// Utilities
+static void
+mock_notify_free(gpointer data)
+{
+  MockNotify *call = data;
+
+  g_free(call->summary);
+  g_free(call->body);
+  g_slice_free(MockNotify, call);
+}
+
+static MockNotify*
+mock_get_call(guint index)
+{
+  g_assert_cmpuint(index, <, mock.notify_calls->len);
+
+  return g_ptr_array_index(mock.notify_calls, index);
+}
+
+static void
+mock_emit(const gchar *signal_name, GVariant *parameters)
+{
+  GError *error = NULL;
+
+  g_dbus_connection_emit_signal(mock.connection, NULL, NOTIFICATIONS_PATH,
+                                NOTIFICATIONS_INTERFACE, signal_name, parameters, &error);
+  g_assert_no_error(error);
+}
+
+static void
+mock_release_replies(void)
+{
+  MockNotify *call;
+
+  mock.hold_replies = FALSE;
+  for (guint i = 0; i < mock.notify_calls->len; i++)
+  {
+    call = mock_get_call(i);
+    if (call->held)
+      g_dbus_method_invocation_return_value(call->held, g_variant_new("(u)", call->id));
+    call->held = NULL;
+  }
+}
+
+static void
+fixture_set_up(Fixture *fixture, gconstpointer data)
+{
+  GDateTime *start;
+
+  g_ptr_array_set_size(mock.notify_calls, 0);
+  g_array_set_size(mock.closed_ids, 0);
+  mock.bubbles = 0;
+  mock.hold_replies = FALSE;
+
+  start = g_date_time_new_utc(2020, 1, 1, 0, 0, 0);
+  fixture->clock = clock_new_virtual(start);
+  fixture->scheduler = scheduler_new(fixture->clock);
+  fixture->notifier = notifier_new(fixture->scheduler);
+  fixture->dismissed = g_array_new(FALSE, FALSE, sizeof(guint));
+  g_date_time_unref(start);
+}
+
+static void
+fixture_tear_down(Fixture *fixture, gconstpointer data)
+{
+  mock_release_replies();
+  notifier_free(fixture->notifier);
+  scheduler_free(fixture->scheduler);
+  clock_free(fixture->clock);
+  g_array_free(fixture->dismissed, TRUE);
+  // Let cancelled calls complete, before their notifier is reused
+  settle();
+}
+
+
+// Callbacks
+static void
+mock_method_call(GDBusConnection *connection, const gchar *sender,
+                 const gchar *object_path, const gchar *interface_name,
+                 const gchar *method_name, GVariant *parameters,
+                 GDBusMethodInvocation *invocation, gpointer user_data)
+{
+  MockNotify *call;
+  const gchar *summary, *body, **actions;
+  guint id;
+
+  if (!g_strcmp0(method_name, "Notify"))
+  {
+    call = g_slice_new0(MockNotify);
+    g_variant_get(parameters, "(&su&s&s&s^a&s@a{sv}i)", NULL, &call->replaces_id, NULL,
+                  &summary, &body, &actions, NULL, NULL);
+    call->summary = g_strdup(summary);
+    call->body = g_strdup(body);
+    call->stop_action = actions[0] != NULL && !g_strcmp0(actions[0], "stop");
+    g_free(actions);
+
+    call->id = call->replaces_id;
+    if (call->id == 0)
+    {
+      call->id = mock.next_id++;
+      mock.bubbles++;
+    }
+    g_ptr_array_add(mock.notify_calls, call);
+
+    if (mock.hold_replies)
+      call->held = invocation;
+    else
+      g_dbus_method_invocation_return_value(invocation, g_variant_new("(u)", call->id));
+  }
+  else if (!g_strcmp0(method_name, "CloseNotification"))
+  {
+    g_variant_get(parameters, "(u)", &id);
+    g_array_append_val(mock.closed_ids, id);
+    mock.bubbles--;
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    mock_emit("NotificationClosed", g_variant_new("(uu)", id, CLOSED_BY_CALL));
+  }
+  else
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                          G_DBUS_ERROR_UNKNOWN_METHOD,
+                                          "Unknown method %s", method_name);
+}
+
+static void
+record_dismissed(guint handle, gpointer user_data)
+{
+  Fixture *fixture = user_data;
+
+  g_array_append_val(fixture->dismissed, handle);
+}
+
+
+// Tests
+static void
+test_show(Fixture *fixture, gconstpointer data)
+{
+  MockNotify *call;
+  guint handle;
+
+  handle = notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Tea", "Ready");
+  g_assert_cmpuint(handle, !=, NOTIFIER_NO_NOTIFICATION);
+
+  wait_for(&mock.notify_calls->len, 1);
+  call = mock_get_call(0);
+  g_assert_cmpuint(call->replaces_id, ==, 0);
+  g_assert_cmpstr(call->summary, ==, "Tea");
+  g_assert_cmpstr(call->body, ==, "Ready");
+  g_assert_true(call->stop_action);
+}
+
+// Repeat sent while the first Notify is in flight would open second bubble
+static void
+test_replace_pending(Fixture *fixture, gconstpointer data)
+{
+  guint handle, first_id;
+
+  // Connect first, so the next Notify is sent right away
+  notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Coffee", NULL);
+  wait_for(&mock.notify_calls->len, 1);
+
+  mock.hold_replies = TRUE;
+  handle = notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Tea", "1");
+  wait_for(&mock.notify_calls->len, 2);
+  notifier_show(fixture->notifier, handle, "Tea", "2");
+  notifier_show(fixture->notifier, handle, "Tea", "3");
+  settle();
+  g_assert_cmpuint(mock.notify_calls->len, ==, 2);
+
+  // Updates are merged and replace the bubble once its id is known
+  first_id = mock_get_call(1)->id;
+  mock_release_replies();
+  wait_for(&mock.notify_calls->len, 3);
+  g_assert_cmpuint(mock_get_call(2)->replaces_id, ==, first_id);
+  g_assert_cmpstr(mock_get_call(2)->body, ==, "3");
+  g_assert_cmpuint(mock.bubbles, ==, 2);
+
+  settle();
+  g_assert_cmpuint(mock.notify_calls->len, ==, 3);
+}
+
+static void
+test_dismissed(Fixture *fixture, gconstpointer data)
+{
+  guint handle, id;
+
+  notifier_set_dismissed_func(fixture->notifier, record_dismissed, fixture);
+  handle = notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Tea", NULL);
+  wait_for(&mock.notify_calls->len, 1);
+  id = mock_get_call(0)->id;
+  settle();
+
+  // Bubble that timed out is not a dismissal
+  mock_emit("NotificationClosed", g_variant_new("(uu)", id, CLOSED_EXPIRED));
+  settle();
+  g_assert_cmpuint(fixture->dismissed->len, ==, 0);
+
+  // Next update opens new bubble
+  notifier_show(fixture->notifier, handle, "Tea", "Again");
+  wait_for(&mock.notify_calls->len, 2);
+  g_assert_cmpuint(mock_get_call(1)->replaces_id, ==, 0);
+  id = mock_get_call(1)->id;
+  settle();
+
+  mock_emit("NotificationClosed", g_variant_new("(uu)", id, CLOSED_DISMISSED));
+  wait_for(&fixture->dismissed->len, 1);
+  g_assert_cmpuint(g_array_index(fixture->dismissed, guint, 0), ==, handle);
+
+  // Bubbles of other clients are ignored
+  mock_emit("NotificationClosed", g_variant_new("(uu)", id + 100, CLOSED_DISMISSED));
+  settle();
+  g_assert_cmpuint(fixture->dismissed->len, ==, 1);
+}
+
+static void
+test_stop_action(Fixture *fixture, gconstpointer data)
+{
+  guint handle;
+
+  notifier_set_dismissed_func(fixture->notifier, record_dismissed, fixture);
+  handle = notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Tea", NULL);
+  wait_for(&mock.notify_calls->len, 1);
+  settle();
+
+  mock_emit("ActionInvoked", g_variant_new("(us)", mock_get_call(0)->id, "stop"));
+  wait_for(&fixture->dismissed->len, 1);
+  g_assert_cmpuint(g_array_index(fixture->dismissed, guint, 0), ==, handle);
+}
+
+static void
+test_close(Fixture *fixture, gconstpointer data)
+{
+  guint handle;
+
+  notifier_set_dismissed_func(fixture->notifier, record_dismissed, fixture);
+  handle = notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Tea", NULL);
+  wait_for(&mock.notify_calls->len, 1);
+  settle();
+
+  notifier_close(fixture->notifier, handle);
+  wait_for(&mock.closed_ids->len, 1);
+  g_assert_cmpuint(g_array_index(mock.closed_ids, guint, 0), ==, mock_get_call(0)->id);
+  g_assert_cmpuint(mock.bubbles, ==, 0);
+
+  // Closing is not reported as dismissal
+  settle();
+  g_assert_cmpuint(fixture->dismissed->len, ==, 0);
+}
+
+// Bubble closed before daemon replied with its id is closed once id arrives
+static void
+test_close_pending(Fixture *fixture, gconstpointer data)
+{
+  guint handle;
+
+  notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Coffee", NULL);
+  wait_for(&mock.notify_calls->len, 1);
+
+  mock.hold_replies = TRUE;
+  handle = notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, "Tea", NULL);
+  wait_for(&mock.notify_calls->len, 2);
+  notifier_close(fixture->notifier, handle);
+
+  mock_release_replies();
+  wait_for(&mock.closed_ids->len, 1);
+  g_assert_cmpuint(g_array_index(mock.closed_ids, guint, 0), ==, mock_get_call(1)->id);
+}
+
+// Burst of notifications is sent at the rate the token bucket allows
+static void
+test_rate_limit(Fixture *fixture, gconstpointer data)
+{
+  gchar summary[16];
+
+  for (guint i = 0; i < 6; i++)
+  {
+    g_snprintf(summary, sizeof(summary), "Alarm %u", i);
+    notifier_show(fixture->notifier, NOTIFIER_NO_NOTIFICATION, summary, NULL);
+  }
+
+  wait_for(&mock.notify_calls->len, 4);
+  settle();
+  g_assert_cmpuint(mock.notify_calls->len, ==, 4);
+  g_assert_true(scheduler_contains(fixture->scheduler, fixture->notifier));
+
+  clock_advance(fixture->clock, 2*G_USEC_PER_SEC);
+  wait_for(&mock.notify_calls->len, 5);
+  clock_advance(fixture->clock, 2*G_USEC_PER_SEC);
+  wait_for(&mock.notify_calls->len, 6);
+  g_assert_cmpstr(mock_get_call(5)->summary, ==, "Alarm 5");
+  g_assert_false(scheduler_contains(fixture->scheduler, fixture->notifier));
+}
+
+
+gint
+main(gint argc, gchar **argv)
+{
+  const GDBusInterfaceVTable vtable = {mock_method_call, NULL, NULL};
+  TestBus *bus;
+  gint result;
+
+  g_test_init(&argc, &argv, NULL);
+
+  // Notifier connects to session bus, which is the private one from now on
+  bus = test_bus_new(NOTIFICATIONS_NAME, NOTIFICATIONS_PATH, mock_daemon_xml, &vtable);
+  mock.connection = test_bus_get_connection(bus);
+  mock.next_id = 1;
+  mock.notify_calls = g_ptr_array_new_with_free_func(mock_notify_free);
+  mock.closed_ids = g_array_new(FALSE, FALSE, sizeof(guint));
+
+  ADD_TEST("/notification/show", test_show);
+  ADD_TEST("/notification/replace-pending", test_replace_pending);
+  ADD_TEST("/notification/dismissed", test_dismissed);
+  ADD_TEST("/notification/stop-action", test_stop_action);
+  ADD_TEST("/notification/close", test_close);
+  ADD_TEST("/notification/close-pending", test_close_pending);
+  ADD_TEST("/notification/rate-limit", test_rate_limit);
+
+  result = g_test_run();
+
+  g_ptr_array_free(mock.notify_calls, TRUE);
+  g_array_free(mock.closed_ids, TRUE);
+  test_bus_free(bus);
+
+  return result;
+}
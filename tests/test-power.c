@@ -0,0 +1,312 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+#include <gio/gunixfdlist.h>
+#include <gtk/gtk.h>
+
+#include "alert.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "power-monitor.h"
+#include "rerun.h"
+#include "alarm-context.h"
+#include "alarm.h"
+#include "test-utils.h"
+
+#define LOGIND_NAME "org.freedesktop.login1"
+#define LOGIND_PATH "/org/freedesktop/login1"
+#define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+
+static const gchar mock_logind_xml[] =
+  "<node>"
+  "  <interface name='" LOGIND_MANAGER_INTERFACE "'>"
+  "    <method name='Inhibit'>"
+  "      <arg type='s' name='what' direction='in'/>"
+  "      <arg type='s' name='who' direction='in'/>"
+  "      <arg type='s' name='why' direction='in'/>"
+  "      <arg type='s' name='mode' direction='in'/>"
+  "      <arg type='h' name='fd' direction='out'/>"
+  "    </method>"
+  "    <signal name='PrepareForSleep'>"
+  "      <arg type='b' name='start'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+/* logind served on private bus, which stands in for the system bus. Inhibitor lock is a pipe: once the plugin closes its end,
+ * the mock reads end of file. */
+typedef struct
+{
+  GDBusConnection *connection;
+  guint inhibit_calls;
+  gint lock; // Read end of the last lock handed out, or -1
+} MockLogind;
+
+typedef struct
+{
+  AlarmContext *context;
+  PowerMonitor *monitor;
+  guint suspends;
+  guint resumes;
+} Fixture;
+
+static MockLogind mock;
+
+
+// Utilities
+static gboolean
+mock_lock_held(void)
+{
+  gchar byte;
+
+  g_assert_cmpint(mock.lock, >=, 0);
+
+  return read(mock.lock, &byte, 1) < 0 && errno == EAGAIN;
+}
+
+static void
+mock_prepare_for_sleep(gboolean start)
+{
+  GError *error = NULL;
+
+  g_dbus_connection_emit_signal(mock.connection, NULL, LOGIND_PATH, LOGIND_MANAGER_INTERFACE,
+                                "PrepareForSleep", g_variant_new("(b)", start), &error);
+  g_assert_no_error(error);
+}
+
+static Alarm*
+add_alarm(AlarmContext *context, AlarmType type, const gchar *name, guint time)
+{
+  Alarm *alarm;
+
+  alarm = alarm_new();
+  g_object_set(alarm, "type", type, "name", name, "time", time, NULL);
+  alarm_list_append(context, alarm);
+
+  return alarm;
+}
+
+static void
+assert_deadline(Alarm *alarm, const gchar *expected)
+{
+  gchar *text;
+
+  g_assert_nonnull(alarm->deadline);
+  text = g_date_time_format(alarm->deadline, "%Y-%m-%dT%H:%M:%SZ");
+  g_assert_cmpstr(text, ==, expected);
+  g_free(text);
+}
+
+
+// Callbacks
+static void
+mock_method_call(GDBusConnection *connection, const gchar *sender,
+                 const gchar *object_path, const gchar *interface_name,
+                 const gchar *method_name, GVariant *parameters,
+                 GDBusMethodInvocation *invocation, gpointer user_data)
+{
+  GUnixFDList *fd_list;
+  GError *error = NULL;
+  gint fds[2], fd_index;
+
+  if (g_strcmp0(method_name, "Inhibit"))
+  {
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                          G_DBUS_ERROR_UNKNOWN_METHOD,
+                                          "Unknown method %s", method_name);
+    return;
+  }
+
+  g_assert_true(g_unix_open_pipe(fds, FD_CLOEXEC, &error));
+  g_assert_true(g_unix_set_fd_nonblocking(fds[0], TRUE, &error));
+
+  // Appending duplicates the descriptor, so only the plugin holds write end
+  fd_list = g_unix_fd_list_new();
+  fd_index = g_unix_fd_list_append(fd_list, fds[1], &error);
+  g_assert_no_error(error);
+  g_close(fds[1], NULL);
+
+  if (mock.lock >= 0)
+    g_close(mock.lock, NULL);
+  mock.lock = fds[0];
+  mock.inhibit_calls++;
+
+  g_dbus_method_invocation_return_value_with_unix_fd_list(invocation,
+                                                          g_variant_new("(h)", fd_index),
+                                                          fd_list);
+  g_object_unref(fd_list);
+}
+
+// Counts dispatches the plugin gets on PrepareForSleep
+static void
+power_changed(gboolean suspending, Fixture *fixture)
+{
+  alarm_context_power_changed(suspending, fixture->context);
+  if (suspending)
+    fixture->suspends++;
+  else
+    fixture->resumes++;
+}
+
+
+// Fixture
+static void
+fixture_set_up(Fixture *fixture, gconstpointer data)
+{
+  GDateTime *start;
+
+  mock.inhibit_calls = 0;
+
+  start = g_date_time_new_utc(2020, 1, 1, 6, 0, 0);
+  fixture->context = alarm_context_new(clock_new_virtual(start), NULL, NULL);
+  g_object_set(fixture->context->alert, "notification", FALSE, NULL);
+  fixture->suspends = 0;
+  fixture->resumes = 0;
+  g_date_time_unref(start);
+
+  fixture->monitor = power_monitor_new((PowerMonitorFunc) power_changed, fixture);
+  wait_for(&mock.inhibit_calls, 1);
+  settle();
+  g_assert_true(mock_lock_held());
+}
+
+static void
+fixture_tear_down(Fixture *fixture, gconstpointer data)
+{
+  power_monitor_free(fixture->monitor);
+  alarm_context_free(fixture->context);
+  settle();
+}
+
+
+// Tests
+static void
+test_suspend_resume(Fixture *fixture, gconstpointer data)
+{
+  AlarmContext *context = fixture->context;
+  Alarm *tea, *meeting, *daily, *laundry, *standup;
+
+  tea = add_alarm(context, ALARM_TYPE_TIMER, "Tea", 60);
+  meeting = add_alarm(context, ALARM_TYPE_CLOCK, "Meeting", 6*3600 + 30*60);
+  daily = add_alarm(context, ALARM_TYPE_CLOCK, "Daily", 7*3600);
+  g_object_set(daily, "rerun-every", RERUN_EVERYDAY, NULL);
+  laundry = add_alarm(context, ALARM_TYPE_TIMER, "Laundry", 3*3600);
+  g_object_set(laundry, "autostop-on-suspend", TRUE, NULL);
+  standup = add_alarm(context, ALARM_TYPE_TIMER, "Stand up", 600);
+  g_object_set(standup, "autostart-on-resume", TRUE, NULL);
+
+  start_alarm(context, tea);
+  start_alarm(context, meeting);
+  start_alarm(context, daily);
+  start_alarm(context, laundry);
+  g_assert_cmpuint(scheduler_size(context->scheduler), ==, 4);
+
+  // Suspend stops what has to stop, then lets the system go
+  mock_prepare_for_sleep(TRUE);
+  wait_for(&fixture->suspends, 1);
+  g_assert_null(laundry->started_at);
+  g_assert_nonnull(tea->started_at);
+  g_assert_false(mock_lock_held());
+
+  // Nothing is dispatched while paused
+  clock_advance(context->clock, 2*60*G_USEC_PER_SEC);
+  g_assert_cmpuint(get_wakeups(context->scheduler), ==, 0);
+  g_assert_nonnull(tea->started_at);
+
+  // Two hours asleep, with monotonic clock standing still
+  clock_suspend(context->clock, 2*3600*G_USEC_PER_SEC);
+
+  mock_prepare_for_sleep(FALSE);
+  wait_for(&fixture->resumes, 1);
+  g_assert_nonnull(standup->started_at);
+  assert_deadline(standup, "2020-01-01T08:12:00Z");
+  g_assert_cmpuint(scheduler_size(context->scheduler), ==, 4);
+
+  // All alarms missed while asleep fire together
+  clock_advance(context->clock, 0);
+  g_assert_cmpuint(get_wakeups(context->scheduler), ==, 1);
+  g_assert_null(tea->started_at);
+  g_assert_null(meeting->started_at);
+  g_assert_nonnull(daily->started_at);
+  assert_deadline(daily, "2020-01-02T07:00:00Z");
+  g_assert_cmpuint(scheduler_size(context->scheduler), ==, 2);
+
+  // Delay lock is taken again for the next suspend
+  wait_for(&mock.inhibit_calls, 2);
+  settle();
+  g_assert_true(mock_lock_held());
+}
+
+// Alarms not running on suspend are left alone
+static void
+test_idle_suspend(Fixture *fixture, gconstpointer data)
+{
+  AlarmContext *context = fixture->context;
+  Alarm *tea;
+
+  tea = add_alarm(context, ALARM_TYPE_TIMER, "Tea", 60);
+
+  mock_prepare_for_sleep(TRUE);
+  wait_for(&fixture->suspends, 1);
+  clock_suspend(context->clock, 3600*G_USEC_PER_SEC);
+  mock_prepare_for_sleep(FALSE);
+  wait_for(&fixture->resumes, 1);
+  clock_advance(context->clock, 0);
+
+  g_assert_null(tea->started_at);
+  g_assert_cmpuint(scheduler_size(context->scheduler), ==, 0);
+  g_assert_cmpuint(get_wakeups(context->scheduler), ==, 0);
+}
+
+
+gint
+main(gint argc, gchar **argv)
+{
+  const GDBusInterfaceVTable vtable = {mock_method_call, NULL, NULL};
+  TestBus *bus;
+  gint result;
+
+  g_setenv("TZ", "UTC", TRUE);
+  g_test_init(&argc, &argv, NULL);
+
+  // Power monitor takes system bus address from environment
+  bus = test_bus_new(LOGIND_NAME, LOGIND_PATH, mock_logind_xml, &vtable);
+  g_setenv("DBUS_SYSTEM_BUS_ADDRESS", test_bus_get_address(bus), TRUE);
+  mock.connection = test_bus_get_connection(bus);
+  mock.lock = -1;
+
+  ADD_TEST("/power/suspend-resume", test_suspend_resume);
+  ADD_TEST("/power/idle-suspend", test_idle_suspend);
+
+  result = g_test_run();
+
+  if (mock.lock >= 0)
+    g_close(mock.lock, NULL);
+  test_bus_free(bus);
+
+  return result;
+}
@@ -0,0 +1,183 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "rerun.h"
+#include "recurrence.h"
+
+/* Times are given in UTC and the test runs with UTC as local time zone, so
+ * expected occurrences do not depend on where the test is run. 2020-01-01 is
+ * Wednesday. */
+typedef struct
+{
+  const gchar *path;
+  guint time;
+  gint rerun_every;
+  RerunMode rerun_mode;
+  const gchar *anchor;
+  const gchar *from; // 'after' for next, 'before' for previous occurrence
+  const gchar *expected; // NULL - no occurrence
+} RecurrenceCase;
+
+static const RecurrenceCase next_cases[] =
+{
+  {"/recurrence/next/once/later-today", 7*3600, NO_RERUN, RERUN_NDAYS,
+   "2020-01-01T06:00:00Z", "2020-01-01T06:00:00Z", "2020-01-01T07:00:00Z"},
+  {"/recurrence/next/once/strictly-after", 7*3600, NO_RERUN, RERUN_NDAYS,
+   "2020-01-01T06:00:00Z", "2020-01-01T07:00:00Z", "2020-01-02T07:00:00Z"},
+  {"/recurrence/next/weekday/skips-weekend", 7*3600, RERUN_WEEKDAY, RERUN_NDAYS,
+   "2020-01-01T06:00:00Z", "2020-01-03T08:00:00Z", "2020-01-06T07:00:00Z"},
+  {"/recurrence/next/weekend/skips-week", 7*3600, RERUN_WEEKEND, RERUN_NDAYS,
+   "2020-01-01T06:00:00Z", "2020-01-06T08:00:00Z", "2020-01-11T07:00:00Z"},
+  {"/recurrence/next/sunday/wraps-week", 23*3600 + 59*60 + 59, RERUN_SUNDAY, RERUN_NDAYS,
+   "2020-01-01T06:00:00Z", "2020-01-05T23:59:59Z", "2020-01-12T23:59:59Z"},
+  {"/recurrence/next/ndays/rounds-up", 7*3600, -3, RERUN_NDAYS,
+   "2020-01-01T06:00:00Z", "2020-01-02T08:00:00Z", "2020-01-04T07:00:00Z"},
+  {"/recurrence/next/ndays/before-first", 7*3600, -2, RERUN_NDAYS,
+   "2020-01-10T08:00:00Z", "2020-01-05T00:00:00Z", "2020-01-11T07:00:00Z"},
+  {"/recurrence/next/nweeks/skips-week", 7*3600, -2, RERUN_NWEEKS,
+   "2020-01-01T06:00:00Z", "2020-01-02T08:00:00Z", "2020-01-15T07:00:00Z"},
+  {"/recurrence/next/nmonths/clamps-day", 7*3600, -1, RERUN_NMONTHS,
+   "2020-01-31T06:00:00Z", "2020-02-01T00:00:00Z", "2020-02-29T07:00:00Z"},
+  {"/recurrence/next/nmonths/restores-day", 7*3600, -1, RERUN_NMONTHS,
+   "2020-01-31T06:00:00Z", "2020-02-29T07:00:00Z", "2020-03-31T07:00:00Z"},
+  {"/recurrence/next/nmonths/crosses-year", 7*3600, -3, RERUN_NMONTHS,
+   "2020-11-15T06:00:00Z", "2020-11-16T00:00:00Z", "2021-02-15T07:00:00Z"},
+};
+
+static const RecurrenceCase previous_cases[] =
+{
+  {"/recurrence/previous/weekday/skips-weekend", 7*3600, RERUN_WEEKDAY, RERUN_NDAYS,
+   "2019-12-01T00:00:00Z", "2020-01-06T07:00:00Z", "2020-01-03T07:00:00Z"},
+  {"/recurrence/previous/nweeks", 7*3600, -2, RERUN_NWEEKS,
+   "2020-01-01T06:00:00Z", "2020-01-20T00:00:00Z", "2020-01-15T07:00:00Z"},
+  {"/recurrence/previous/nmonths", 7*3600, -1, RERUN_NMONTHS,
+   "2020-01-31T06:00:00Z", "2020-03-31T07:00:00Z", "2020-02-29T07:00:00Z"},
+  {"/recurrence/previous/none-since-anchor", 7*3600, RERUN_EVERYDAY, RERUN_NDAYS,
+   "2020-01-01T08:00:00Z", "2020-01-02T07:00:00Z", NULL},
+};
+
+
+// Utilities
+static GDateTime*
+parse_time(const gchar *text)
+{
+  GDateTime *time;
+
+  time = g_date_time_new_from_iso8601(text, NULL);
+  g_assert_nonnull(time);
+
+  return time;
+}
+
+static void
+assert_occurrence(GDateTime *occurrence, const gchar *expected)
+{
+  gchar *text;
+
+  if (expected == NULL)
+  {
+    g_assert_null(occurrence);
+    return;
+  }
+
+  g_assert_nonnull(occurrence);
+  text = g_date_time_format(occurrence, "%Y-%m-%dT%H:%M:%SZ");
+  g_assert_cmpstr(text, ==, expected);
+  g_free(text);
+}
+
+
+// Tests
+static void
+test_next(gconstpointer data)
+{
+  const RecurrenceCase *test_case = data;
+  GDateTime *anchor, *after, *occurrence;
+
+  anchor = parse_time(test_case->anchor);
+  after = parse_time(test_case->from);
+  occurrence = recurrence_next(test_case->time, test_case->rerun_every,
+                               test_case->rerun_mode, anchor, after);
+  assert_occurrence(occurrence, test_case->expected);
+
+  g_date_time_unref(occurrence);
+  g_date_time_unref(after);
+  g_date_time_unref(anchor);
+}
+
+static void
+test_previous(gconstpointer data)
+{
+  const RecurrenceCase *test_case = data;
+  GDateTime *anchor, *before, *occurrence;
+
+  anchor = parse_time(test_case->anchor);
+  before = parse_time(test_case->from);
+  occurrence = recurrence_previous(test_case->time, test_case->rerun_every,
+                                   test_case->rerun_mode, anchor, before);
+  assert_occurrence(occurrence, test_case->expected);
+
+  g_clear_pointer(&occurrence, g_date_time_unref);
+  g_date_time_unref(before);
+  g_date_time_unref(anchor);
+}
+
+// Every occurrence is strictly later than the one it follows
+static void
+test_next_advances(void)
+{
+  GDateTime *anchor, *occurrence, *next;
+
+  anchor = parse_time("2020-01-01T06:00:00Z");
+  occurrence = g_date_time_ref(anchor);
+  for (guint i = 0; i < 100; i++)
+  {
+    next = recurrence_next(7*3600, RERUN_WEEKDAY, RERUN_NDAYS, anchor, occurrence);
+    g_assert_cmpint(g_date_time_compare(next, occurrence), >, 0);
+    g_assert_cmpint(g_date_time_get_day_of_week(next), <=, 5);
+    g_date_time_unref(occurrence);
+    occurrence = next;
+  }
+  // 100 weekdays are 20 weeks
+  assert_occurrence(occurrence, "2020-05-19T07:00:00Z");
+
+  g_date_time_unref(occurrence);
+  g_date_time_unref(anchor);
+}
+
+
+gint
+main(gint argc, gchar **argv)
+{
+  g_setenv("TZ", "UTC", TRUE);
+  g_test_init(&argc, &argv, NULL);
+
+  for (guint i = 0; i < G_N_ELEMENTS(next_cases); i++)
+    g_test_add_data_func(next_cases[i].path, &next_cases[i], test_next);
+  for (guint i = 0; i < G_N_ELEMENTS(previous_cases); i++)
+    g_test_add_data_func(previous_cases[i].path, &previous_cases[i], test_previous);
+  g_test_add_func("/recurrence/next/advances", test_next_advances);
+
+  return g_test_run();
+}
@@ -0,0 +1,252 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "clock.h"
+#include "scheduler.h"
+#include "test-utils.h"
+
+typedef struct
+{
+  Clock *clock;
+  Scheduler *scheduler;
+  GPtrArray *fired; // Keys in order of dispatch
+  gint64 last_fired_at;
+} Fixture;
+
+static gchar key_a[] = "a", key_b[] = "b", key_c[] = "c";
+
+
+// Utilities
+static void
+fixture_set_up(Fixture *fixture, gconstpointer data)
+{
+  GDateTime *start;
+
+  start = g_date_time_new_utc(2020, 1, 1, 0, 0, 0);
+  fixture->clock = clock_new_virtual(start);
+  fixture->scheduler = scheduler_new(fixture->clock);
+  fixture->fired = g_ptr_array_new();
+  g_date_time_unref(start);
+}
+
+static void
+fixture_tear_down(Fixture *fixture, gconstpointer data)
+{
+  g_ptr_array_free(fixture->fired, TRUE);
+  scheduler_free(fixture->scheduler);
+  clock_free(fixture->clock);
+}
+
+
+// Callbacks
+static void
+record_fired(gpointer key, gpointer user_data)
+{
+  Fixture *fixture = user_data;
+
+  g_ptr_array_add(fixture->fired, key);
+  fixture->last_fired_at = scheduler_get_time(fixture->scheduler);
+}
+
+// Reschedules itself one second later, until fired five times
+static void
+record_and_repeat(gpointer key, gpointer user_data)
+{
+  Fixture *fixture = user_data;
+
+  record_fired(key, user_data);
+  if (fixture->fired->len < 5)
+    scheduler_add(fixture->scheduler, key, fixture->last_fired_at + G_USEC_PER_SEC,
+                  record_and_repeat, fixture);
+}
+
+
+// Tests
+static void
+test_order(Fixture *fixture, gconstpointer data)
+{
+  Scheduler *scheduler = fixture->scheduler;
+
+  g_assert_cmpuint(scheduler_size(scheduler), ==, 0);
+  g_assert_null(scheduler_next_key(scheduler));
+  g_assert_cmpint(scheduler_next_deadline(scheduler), ==, SCHEDULER_NO_DEADLINE);
+
+  scheduler_add(scheduler, key_b, 2*G_USEC_PER_SEC, record_fired, fixture);
+  scheduler_add(scheduler, key_c, 3*G_USEC_PER_SEC, record_fired, fixture);
+  scheduler_add(scheduler, key_a, 1*G_USEC_PER_SEC, record_fired, fixture);
+
+  g_assert_cmpuint(scheduler_size(scheduler), ==, 3);
+  g_assert_true(scheduler_next_key(scheduler) == key_a);
+  g_assert_cmpint(scheduler_next_deadline(scheduler), ==, G_USEC_PER_SEC);
+  g_assert_cmpint(scheduler_get_deadline(scheduler, key_c), ==, 3*G_USEC_PER_SEC);
+
+  clock_advance(fixture->clock, 2*G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 2);
+  g_assert_true(g_ptr_array_index(fixture->fired, 0) == key_a);
+  g_assert_true(g_ptr_array_index(fixture->fired, 1) == key_b);
+  g_assert_cmpint(fixture->last_fired_at, ==, 2*G_USEC_PER_SEC);
+  g_assert_cmpuint(scheduler_size(scheduler), ==, 1);
+  g_assert_false(scheduler_contains(scheduler, key_a));
+  g_assert_true(scheduler_next_key(scheduler) == key_c);
+
+  clock_advance(fixture->clock, 10*G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 3);
+  g_assert_true(g_ptr_array_index(fixture->fired, 2) == key_c);
+  g_assert_cmpuint(scheduler_size(scheduler), ==, 0);
+  g_assert_cmpuint(get_wakeups(scheduler), ==, 3);
+}
+
+static void
+test_reschedule(Fixture *fixture, gconstpointer data)
+{
+  Scheduler *scheduler = fixture->scheduler;
+
+  scheduler_add(scheduler, key_a, 1*G_USEC_PER_SEC, record_fired, fixture);
+  scheduler_add(scheduler, key_b, 2*G_USEC_PER_SEC, record_fired, fixture);
+
+  // Existing key is moved, not duplicated
+  scheduler_add(scheduler, key_a, 5*G_USEC_PER_SEC, record_fired, fixture);
+  g_assert_cmpuint(scheduler_size(scheduler), ==, 2);
+  g_assert_true(scheduler_next_key(scheduler) == key_b);
+  g_assert_cmpint(scheduler_get_deadline(scheduler, key_a), ==, 5*G_USEC_PER_SEC);
+
+  clock_advance(fixture->clock, 4*G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 1);
+  g_assert_true(g_ptr_array_index(fixture->fired, 0) == key_b);
+
+  clock_advance(fixture->clock, G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 2);
+  g_assert_cmpint(fixture->last_fired_at, ==, 5*G_USEC_PER_SEC);
+}
+
+static void
+test_remove(Fixture *fixture, gconstpointer data)
+{
+  Scheduler *scheduler = fixture->scheduler;
+
+  scheduler_add(scheduler, key_a, 1*G_USEC_PER_SEC, record_fired, fixture);
+  g_assert_true(scheduler_remove(scheduler, key_a));
+  g_assert_false(scheduler_remove(scheduler, key_a));
+  g_assert_false(scheduler_contains(scheduler, key_a));
+  g_assert_cmpint(scheduler_get_deadline(scheduler, key_a), ==, SCHEDULER_NO_DEADLINE);
+  g_assert_cmpint(scheduler_next_deadline(scheduler), ==, SCHEDULER_NO_DEADLINE);
+
+  clock_advance(fixture->clock, 10*G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 0);
+  g_assert_cmpuint(get_wakeups(scheduler), ==, 0);
+}
+
+// Entries due at the same time share a single wakeup
+static void
+test_coalesce(Fixture *fixture, gconstpointer data)
+{
+  Scheduler *scheduler = fixture->scheduler;
+
+  scheduler_add(scheduler, key_a, G_USEC_PER_SEC, record_fired, fixture);
+  scheduler_add(scheduler, key_b, G_USEC_PER_SEC, record_fired, fixture);
+  scheduler_add(scheduler, key_c, G_USEC_PER_SEC, record_fired, fixture);
+
+  clock_advance(fixture->clock, G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 3);
+  g_assert_cmpuint(get_wakeups(scheduler), ==, 1);
+}
+
+static void
+test_reschedule_from_callback(Fixture *fixture, gconstpointer data)
+{
+  Scheduler *scheduler = fixture->scheduler;
+
+  scheduler_add(scheduler, key_a, G_USEC_PER_SEC, record_and_repeat, fixture);
+
+  clock_advance(fixture->clock, 60*G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 5);
+  g_assert_cmpint(fixture->last_fired_at, ==, 5*G_USEC_PER_SEC);
+  g_assert_cmpuint(scheduler_size(scheduler), ==, 0);
+  g_assert_cmpuint(get_wakeups(scheduler), ==, 5);
+}
+
+static void
+test_pause(Fixture *fixture, gconstpointer data)
+{
+  Scheduler *scheduler = fixture->scheduler;
+
+  scheduler_add(scheduler, key_a, 1*G_USEC_PER_SEC, record_fired, fixture);
+  scheduler_pause(scheduler);
+  scheduler_add(scheduler, key_b, 2*G_USEC_PER_SEC, record_fired, fixture);
+
+  clock_advance(fixture->clock, 10*G_USEC_PER_SEC);
+  g_assert_cmpuint(fixture->fired->len, ==, 0);
+  g_assert_cmpuint(scheduler_size(scheduler), ==, 2);
+
+  // Entries which expired while paused are dispatched together
+  scheduler_resume(scheduler);
+  clock_advance(fixture->clock, 0);
+  g_assert_cmpuint(fixture->fired->len, ==, 2);
+  g_assert_true(g_ptr_array_index(fixture->fired, 0) == key_a);
+  g_assert_cmpint(fixture->last_fired_at, ==, 10*G_USEC_PER_SEC);
+  g_assert_cmpuint(get_wakeups(scheduler), ==, 1);
+}
+
+// Rate covers only the window, or the span of remembered wakeups in a burst
+static void
+test_wakeup_rate(Fixture *fixture, gconstpointer data)
+{
+  Scheduler *scheduler = fixture->scheduler;
+
+  g_assert_cmpfloat(scheduler_get_wakeup_rate(scheduler, 60*G_USEC_PER_SEC), ==, 0.0);
+
+  scheduler_add(scheduler, key_a, G_USEC_PER_SEC, record_and_repeat, fixture);
+  clock_advance(fixture->clock, 5*G_USEC_PER_SEC);
+  g_assert_cmpfloat_with_epsilon(scheduler_get_wakeup_rate(scheduler, 60*G_USEC_PER_SEC),
+                                 5.0 / 60, 1e-9);
+
+  clock_advance(fixture->clock, 60*G_USEC_PER_SEC);
+  g_assert_cmpfloat(scheduler_get_wakeup_rate(scheduler, 60*G_USEC_PER_SEC), ==, 0.0);
+
+  // 100 wakeups 10 ms apart, of which the last 64 span 0.63 s
+  for (guint i = 0; i < 100; i++)
+    scheduler_add(scheduler, GUINT_TO_POINTER(i + 1),
+                  scheduler_get_time(scheduler) + (i + 1) * 10 * G_TIME_SPAN_MILLISECOND,
+                  record_fired, fixture);
+  clock_advance(fixture->clock, G_USEC_PER_SEC);
+  g_assert_cmpfloat_with_epsilon(scheduler_get_wakeup_rate(scheduler, 60*G_USEC_PER_SEC),
+                                 100.0, 1e-6);
+}
+
+
+gint
+main(gint argc, gchar **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  ADD_TEST("/scheduler/order", test_order);
+  ADD_TEST("/scheduler/reschedule", test_reschedule);
+  ADD_TEST("/scheduler/remove", test_remove);
+  ADD_TEST("/scheduler/coalesce", test_coalesce);
+  ADD_TEST("/scheduler/reschedule-from-callback", test_reschedule_from_callback);
+  ADD_TEST("/scheduler/pause", test_pause);
+  ADD_TEST("/scheduler/wakeup-rate", test_wakeup_rate);
+
+  return g_test_run();
+}
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "clock.h"
+#include "scheduler.h"
+#include "test-utils.h"
+
+#define WAIT_TIMEOUT (5*G_USEC_PER_SEC)
+
+/* Private message bus with a mock service on it, served from the test process
+ * over its own connection, so the code under test talks to it as to any other
+ * peer. */
+struct _TestBus
+{
+  GTestDBus *bus;
+  GDBusConnection *connection;
+  GDBusNodeInfo *node_info;
+  guint registration_id;
+};
+
+
+// External interface
+// Runs main loop until counter reaches value
+void
+wait_for(const guint *counter, guint value)
+{
+  gint64 deadline = g_get_monotonic_time() + WAIT_TIMEOUT;
+
+  while (*counter < value)
+  {
+    g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+    if (!g_main_context_iteration(NULL, FALSE))
+      g_usleep(1000);
+  }
+}
+
+// Gives in-flight messages a chance to arrive, for checks that nothing did
+void
+settle(void)
+{
+  gint64 deadline = g_get_monotonic_time() + G_USEC_PER_SEC / 10;
+
+  while (g_get_monotonic_time() < deadline)
+    if (!g_main_context_iteration(NULL, FALSE))
+      g_usleep(1000);
+}
+
+guint64
+get_wakeups(Scheduler *scheduler)
+{
+  guint64 wakeups;
+
+  scheduler_get_stats(scheduler, &wakeups, NULL);
+
+  return wakeups;
+}
+
+/* Starts private bus, which also becomes the session bus of the process, and
+ * serves the first interface of xml at path under well-known name. */
+TestBus*
+test_bus_new(const gchar *name, const gchar *path, const gchar *xml,
+             const GDBusInterfaceVTable *vtable)
+{
+  TestBus *bus;
+  GVariant *reply;
+
+  g_return_val_if_fail(name != NULL, NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(xml != NULL, NULL);
+  g_return_val_if_fail(vtable != NULL, NULL);
+
+  bus = g_slice_new0(TestBus);
+  bus->bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(bus->bus);
+
+  bus->connection = g_dbus_connection_new_for_address_sync(
+    g_test_dbus_get_bus_address(bus->bus),
+    G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+    G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+    NULL, NULL, NULL);
+  g_assert_nonnull(bus->connection);
+
+  bus->node_info = g_dbus_node_info_new_for_xml(xml, NULL);
+  g_assert_nonnull(bus->node_info);
+  bus->registration_id = g_dbus_connection_register_object(bus->connection, path,
+                                                           bus->node_info->interfaces[0],
+                                                           vtable, NULL, NULL, NULL);
+  g_assert_cmpuint(bus->registration_id, !=, 0);
+
+  // DBUS_NAME_FLAG_DO_NOT_QUEUE
+  reply = g_dbus_connection_call_sync(bus->connection, "org.freedesktop.DBus",
+                                      "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                      "RequestName", g_variant_new("(su)", name, 0x4),
+                                      G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE,
+                                      -1, NULL, NULL);
+  g_assert_nonnull(reply);
+  g_variant_unref(reply);
+
+  return bus;
+}
+
+void
+test_bus_free(TestBus *bus)
+{
+  if (bus == NULL)
+    return;
+
+  g_dbus_connection_unregister_object(bus->connection, bus->registration_id);
+  g_dbus_node_info_unref(bus->node_info);
+  g_object_unref(bus->connection);
+  g_test_dbus_down(bus->bus);
+  g_object_unref(bus->bus);
+
+  g_slice_free(TestBus, bus);
+}
+
+const gchar*
+test_bus_get_address(TestBus *bus)
+{
+  g_return_val_if_fail(bus != NULL, NULL);
+
+  return g_test_dbus_get_bus_address(bus->bus);
+}
+
+// Connection the mock is served on, for emitting its signals
+GDBusConnection*
+test_bus_get_connection(TestBus *bus)
+{
+  g_return_val_if_fail(bus != NULL, NULL);
+
+  return bus->connection;
+}
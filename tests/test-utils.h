@@ -0,0 +1,43 @@
+/*
+ *  Copyright (C) 2020 cryptogopher
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALARM_PLUGIN_TEST_UTILS_H__
+#define __ALARM_PLUGIN_TEST_UTILS_H__
+
+G_BEGIN_DECLS
+
+// Expects Fixture, fixture_set_up() and fixture_tear_down() of the test
+#define ADD_TEST(path, func) \
+  g_test_add(path, Fixture, NULL, fixture_set_up, func, fixture_tear_down)
+
+typedef struct _TestBus TestBus;
+
+void wait_for(const guint *counter, guint value);
+void settle(void);
+guint64 get_wakeups(Scheduler *scheduler);
+
+TestBus* test_bus_new(const gchar *name, const gchar *path, const gchar *xml,
+                      const GDBusInterfaceVTable *vtable);
+void test_bus_free(TestBus *bus);
+
+const gchar* test_bus_get_address(TestBus *bus);
+GDBusConnection* test_bus_get_connection(TestBus *bus);
+
+G_END_DECLS
+
+#endif /* !__ALARM_PLUGIN_TEST_UTILS_H__ */